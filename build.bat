@@ -45,10 +45,19 @@ if %mode%==debug (
   echo debug mode
 ) else (
   set libs=%libs% "%moose_dir%\3rdparty\freetype\lib\freetype.lib"
-  set options=%options% /O2 /MT
+  rem debug draws are compiled out, see code\debug_draw.h
+  set options=%options% /O2 /MT /DGAME_NO_DEBUG_DRAW
   echo release mode
 )
 
+rem set to 1 to record profile zones, see code\profiler.h
+set profile=0
+
+if %profile%==1 (
+  set options=%options% /DPROFILER_ENABLED
+  echo profiler enabled
+)
+
 set t=%time:~0,8%
 set t=%t::=-%
 
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# builds the headless simulation runner and the physics benchmark,
+# see code/headless_main.cpp and code/benchmark_main.cpp
+
+exe_name=astroids_headless
+benchmark_name=astroids_benchmark
+
+# paths relative to build dir
+moose_dir=$PWD/../mooselib
+
+include_dirs="-I$moose_dir/code"
+options="-std=c++11 -g -pthread -ffp-contract=off"
+
+mode=release
+
+# set to 1 to record profile zones, see code/profiler.h
+profile=0
+
+if [ "$mode" = debug ]; then
+	options="$options -O0 -DDEBUG"
+	echo debug mode
+else
+	options="$options -O2 -march=native"
+	echo release mode
+fi
+
+if [ "$profile" = 1 ]; then
+	options="$options -DPROFILER_ENABLED"
+	echo profiler enabled
+fi
+
+mkdir -p build
+cd build || exit 1
+
+g++ -o "$exe_name" $options $include_dirs "../code/headless_main.cpp" || exit 1
+g++ -o "$benchmark_name" $options $include_dirs "../code/benchmark_main.cpp" || exit 1
@@ -0,0 +1,379 @@
+// physics scaling benchmark, runs update_physics for a range of asteroid counts and densities
+// and writes the results as json, to compare runs across changes.
+//
+// usage: benchmark [-frames count] [-seed seed] [-workers count] [-max-steps count] [-out file]
+//
+// each case runs in its own child process, so the peak memory of one case
+// does not hide the next one. linux only.
+
+#include <memory_growing_stack.h>
+#include <memory_c_allocator.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define Template_Geometry_Dimension_Count 3
+#include "geometry.h"
+
+#define GAME_NO_DEBUG_DRAW
+#include "game.h"
+
+// spawned like in the game, but on a jittered grid,
+// spawn_asteroids can not guarantee the asteroid count at high density
+#define Benchmark_Asteroid_Scale Asteroid_Spawn_Scale
+
+const u32 Benchmark_Asteroid_Counts[] = { 16, 256, 4096, 32768, 100000 };
+
+// fraction of the game area covered by asteroids
+const f32 Benchmark_Densities[] = { 0.05f, 0.15f, 0.3f };
+
+#define Benchmark_Warm_Up_Frame_Count 10
+
+struct Benchmark_Options {
+    u32 frame_count;
+    u64 seed;
+    u32 worker_count;
+    u32 max_physics_step_count;
+    const char *output_path;
+};
+
+struct Benchmark_Result {
+    u32 asteroid_count;
+    f32 density;
+    vec3f area_size;
+    
+    u64 min_ns_per_frame;
+    u64 max_ns_per_frame;
+    f64 average_ns_per_frame;
+    
+    f64 average_physics_steps_per_frame;
+    u32 max_physics_steps_per_frame;
+    f64 average_pair_tests_per_frame;
+    u32 max_pair_tests_per_frame;
+    
+    u64 peak_transient_bytes;
+    
+    // high-water marks of the physics scratch arenas,
+    // and frames that needed more than the reserved scratch memory
+    u64 physics_arena_bytes;
+    u64 physics_temporary_arena_bytes;
+    u32 scratch_overflow_frame_count;
+    
+    bool ok;
+};
+
+bool parse_options(Benchmark_Options *options, int argument_count, char **arguments) {
+    for (int i = 1; i < argument_count; ++i) {
+        // all options have a value
+        if (i + 1 == argument_count) {
+            fprintf(stderr, "missing value for option %s\n", arguments[i]);
+            return false;
+        }
+        
+        char *value = arguments[i + 1];
+        
+        if (!strcmp(arguments[i], "-frames"))
+            options->frame_count = strtoul(value, null, 10);
+        else if (!strcmp(arguments[i], "-seed"))
+            options->seed = strtoull(value, null, 10);
+        else if (!strcmp(arguments[i], "-workers"))
+            options->worker_count = CLAMP(strtoul(value, null, 10), 1, Max_Worker_Count);
+        else if (!strcmp(arguments[i], "-max-steps"))
+            options->max_physics_step_count = strtoul(value, null, 10);
+        else if (!strcmp(arguments[i], "-out"))
+            options->output_path = value;
+        else {
+            fprintf(stderr, "unknown option %s\n", arguments[i]);
+            return false;
+        }
+        
+        ++i;
+    }
+    
+    if (!options->frame_count) {
+        fprintf(stderr, "-frames has to be at least 1\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// peak resident memory of this process
+u64 get_peak_resident_bytes() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    
+    // kilobytes on linux
+    return cast_v(u64, usage.ru_maxrss) * 1024;
+}
+
+// spawns asteroids in a 16:9 area sized for the density,
+// one asteroid per grid cell with random offset, so none overlap.
+// the cell of the ship at the origin stays empty.
+Game_Area spawn_benchmark_asteroids(Game_State *game, u32 asteroid_count, f32 density, Memory_Allocator *allocator) {
+    f32 radius = Benchmark_Asteroid_Scale;
+    f32 area = asteroid_count * PIf * radius * radius / density;
+    
+    vec3f area_size;
+    area_size.y = sqrt(area * 9.0f / 16.0f);
+    area_size.x = area / area_size.y;
+    area_size.z = 0.0f;
+    
+    f32 cell_size = sqrt(area / asteroid_count);
+    
+    // one spare cell for the ship
+    u32 column_count = cast_v(u32, ceil(area_size.x / cell_size));
+    u32 row_count    = cast_v(u32, ceil(area_size.y / cell_size));
+    
+    while (column_count * row_count < asteroid_count + 1)
+        ++row_count;
+    
+    vec3f cell_extent = vec3f{ area_size.x / column_count, area_size.y / row_count, 0.0f };
+    
+    // keep asteroids apart by at least the physics margin
+    vec3f max_offset = cell_extent * 0.5f - vec3f{ radius + 0.1f, radius + 0.1f, 0.0f };
+    assert((max_offset.x >= 0.0f) && (max_offset.y >= 0.0f));
+    
+    Game_Area game_area = { area_size * -0.5f, area_size };
+    
+    u32 cell_count = column_count * row_count;
+    u32 *cell_indices = ALLOCATE_ARRAY(allocator, u32, cell_count);
+    defer { free(allocator, cell_indices); };
+    
+    for (u32 i = 0; i < cell_count; ++i)
+        cell_indices[i] = i;
+    
+    // fisher yates shuffle, so spare cells are spread over the area
+    for (u32 i = cell_count - 1; i > 0; --i) {
+        u32 j = random_index(&game->random, i + 1);
+        
+        u32 temp = cell_indices[i];
+        cell_indices[i] = cell_indices[j];
+        cell_indices[j] = temp;
+    }
+    
+    u32 ship_cell_index = cast_v(u32, -game_area.bottem_left_corner.y / cell_extent.y) * column_count + cast_v(u32, -game_area.bottem_left_corner.x / cell_extent.x);
+    
+    u32 spawn_count = 0;
+    for (u32 i = 0; (i < cell_count) && (spawn_count < asteroid_count); ++i) {
+        if (cell_indices[i] == ship_cell_index)
+            continue;
+        
+        u32 x = cell_indices[i] % column_count;
+        u32 y = cell_indices[i] / column_count;
+        
+        vec3f position = game_area.bottem_left_corner + vec3f{ (x + 0.5f) * cell_extent.x, (y + 0.5f) * cell_extent.y, 0.0f };
+        position.x += random_f32(&game->random, -max_offset.x, max_offset.x);
+        position.y += random_f32(&game->random, -max_offset.y, max_offset.y);
+        
+        vec3f color = random_unit_vector(&game->random) * 0.5f + vec3f{1.0f, 1.0f, 1.0f};
+        
+        spawn_asteroid(game, position, vec3f{}, Benchmark_Asteroid_Scale, make_vec4(color));
+        ++spawn_count;
+    }
+    
+    assert(spawn_count == asteroid_count);
+    
+    return game_area;
+}
+
+Benchmark_Result run_benchmark(Benchmark_Options options, u32 asteroid_count, f32 density) {
+    init_memory_growing_stack_allocators();
+    
+    auto root_memory = make_c_allocator();
+    auto transient_memory  = make_growing_stack_allocator(&root_memory.allocator);
+    
+    Benchmark_Result result = {};
+    result.asteroid_count = asteroid_count;
+    result.density = density;
+    result.min_ns_per_frame = cast_v(u64, -1);
+    
+    Game_State game = {};
+    init_game(&game, &root_memory.allocator, asteroid_count + 2);
+    reset_game(&game, options.seed);
+    
+    Game_Area game_area = spawn_benchmark_asteroids(&game, asteroid_count, density, &transient_memory.allocator);
+    result.area_size = game_area.size;
+    
+    Physics_Settings physics_settings;
+    physics_settings.margin = 0.2f;
+    physics_settings.max_physics_step_count = options.max_physics_step_count;
+    physics_settings.use_brute_force_broadphase = false;
+    physics_settings.narrowphase_worker_count = options.worker_count;
+    
+    // one simulation step per frame
+    f32 delta_seconds = game.physics_timestep;
+    
+    // everything up to here is persistent
+    u64 resident_bytes_before = get_peak_resident_bytes();
+    
+    for (u32 frame = 0; frame < Benchmark_Warm_Up_Frame_Count; ++frame)
+        update_physics(&game, game_area, delta_seconds, false, physics_settings, null);
+    
+    u64 total_ns = 0;
+    u64 total_physics_step_count = 0;
+    u64 total_pair_test_count = 0;
+    
+    for (u32 frame = 0; frame < options.frame_count; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        
+        Physics_Step_Info info = update_physics(&game, game_area, delta_seconds, false, physics_settings, null);
+        
+        auto end = std::chrono::steady_clock::now();
+        u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        
+        total_ns += ns;
+        result.min_ns_per_frame = MIN(result.min_ns_per_frame, ns);
+        result.max_ns_per_frame = MAX(result.max_ns_per_frame, ns);
+        
+        total_physics_step_count += info.physics_step_count;
+        result.max_physics_steps_per_frame = MAX(result.max_physics_steps_per_frame, info.physics_step_count);
+        
+        total_pair_test_count += info.pair_test_count;
+        result.max_pair_tests_per_frame = MAX(result.max_pair_tests_per_frame, info.pair_test_count);
+        
+        if (game.physics_arena.overflow_block_count || game.physics_temporary_arena.overflow_block_count)
+            ++result.scratch_overflow_frame_count;
+    }
+    
+    result.average_ns_per_frame            = total_ns / cast_v(f64, options.frame_count);
+    result.average_physics_steps_per_frame = total_physics_step_count / cast_v(f64, options.frame_count);
+    result.average_pair_tests_per_frame    = total_pair_test_count / cast_v(f64, options.frame_count);
+    
+    // growth of the peak resident memory while simulating,
+    // the persistent entities and bodies are already touched before
+    result.peak_transient_bytes = get_peak_resident_bytes() - resident_bytes_before;
+    
+    result.physics_arena_bytes           = get_max_high_water_byte_count(&game.physics_arena);
+    result.physics_temporary_arena_bytes = get_max_high_water_byte_count(&game.physics_temporary_arena);
+    result.ok = true;
+    
+    return result;
+}
+
+// runs the case in a child process and reads the result through a pipe
+Benchmark_Result run_benchmark_process(Benchmark_Options options, u32 asteroid_count, f32 density) {
+    Benchmark_Result result = {};
+    result.asteroid_count = asteroid_count;
+    result.density = density;
+    
+    int pipe_ends[2];
+    if (pipe(pipe_ends))
+        return result;
+    
+    fflush(stdout);
+    fflush(stderr);
+    
+    pid_t child = fork();
+    
+    if (child == 0) {
+        close(pipe_ends[0]);
+        
+        Benchmark_Result child_result = run_benchmark(options, asteroid_count, density);
+        bool ok = (write(pipe_ends[1], &child_result, sizeof(child_result)) == sizeof(child_result));
+        
+        close(pipe_ends[1]);
+        _exit(ok ? 0 : 1);
+    }
+    
+    close(pipe_ends[1]);
+    
+    if (child > 0) {
+        Benchmark_Result child_result;
+        if (read(pipe_ends[0], &child_result, sizeof(child_result)) == sizeof(child_result))
+            result = child_result;
+        
+        waitpid(child, null, 0);
+    }
+    
+    close(pipe_ends[0]);
+    
+    return result;
+}
+
+int main(int argument_count, char **arguments) {
+    Benchmark_Options options;
+    options.frame_count = 120;
+    options.seed = 0;
+    options.worker_count = get_worker_count();
+    options.max_physics_step_count = 0;
+    options.output_path = null;
+    
+    if (!parse_options(&options, argument_count, arguments))
+        return 1;
+    
+    FILE *output = stdout;
+    
+    if (options.output_path) {
+        output = fopen(options.output_path, "w");
+        
+        if (!output) {
+            fprintf(stderr, "could not open %s\n", options.output_path);
+            return 1;
+        }
+    }
+    
+    fprintf(output, "{\n");
+    fprintf(output, "    \"frames\": %u,\n", options.frame_count);
+    fprintf(output, "    \"warm_up_frames\": %u,\n", Benchmark_Warm_Up_Frame_Count);
+    fprintf(output, "    \"seed\": %llu,\n", cast_v(unsigned long long, options.seed));
+    fprintf(output, "    \"workers\": %u,\n", options.worker_count);
+    fprintf(output, "    \"max_physics_steps\": %u,\n", options.max_physics_step_count);
+    fprintf(output, "    \"physics_hz\": %u,\n", Default_Physics_Hz);
+    fprintf(output, "    \"results\": [");
+    
+    bool is_first = true;
+    
+    for (u32 count_index = 0; count_index < ARRAY_COUNT(Benchmark_Asteroid_Counts); ++count_index) {
+        for (u32 density_index = 0; density_index < ARRAY_COUNT(Benchmark_Densities); ++density_index) {
+            u32 asteroid_count = Benchmark_Asteroid_Counts[count_index];
+            f32 density = Benchmark_Densities[density_index];
+            
+            fprintf(stderr, "asteroids: %u density: %.2f\n", asteroid_count, density);
+            
+            Benchmark_Result result = run_benchmark_process(options, asteroid_count, density);
+            
+            if (!result.ok)
+                fprintf(stderr, "    failed\n");
+            else
+                fprintf(stderr, "    %.0f ns per frame\n", result.average_ns_per_frame);
+            
+            fprintf(output, is_first ? "\n" : ",\n");
+            is_first = false;
+            
+            fprintf(output, "        {\n");
+            fprintf(output, "            \"asteroids\": %u,\n", result.asteroid_count);
+            fprintf(output, "            \"density\": %.3f,\n", result.density);
+            fprintf(output, "            \"ok\": %s", result.ok ? "true" : "false");
+            
+            if (result.ok) {
+                fprintf(output, ",\n");
+                fprintf(output, "            \"area_width\": %.3f,\n", result.area_size.x);
+                fprintf(output, "            \"area_height\": %.3f,\n", result.area_size.y);
+                fprintf(output, "            \"ns_per_frame\": { \"average\": %.1f, \"min\": %llu, \"max\": %llu },\n", result.average_ns_per_frame, cast_v(unsigned long long, result.min_ns_per_frame), cast_v(unsigned long long, result.max_ns_per_frame));
+                fprintf(output, "            \"physics_steps_per_frame\": { \"average\": %.3f, \"max\": %u },\n", result.average_physics_steps_per_frame, result.max_physics_steps_per_frame);
+                fprintf(output, "            \"pair_tests_per_frame\": { \"average\": %.1f, \"max\": %u },\n", result.average_pair_tests_per_frame, result.max_pair_tests_per_frame);
+                fprintf(output, "            \"peak_transient_bytes\": %llu,\n", cast_v(unsigned long long, result.peak_transient_bytes));
+                fprintf(output, "            \"scratch_high_water_bytes\": { \"physics\": %llu, \"physics_temporary\": %llu },\n", cast_v(unsigned long long, result.physics_arena_bytes), cast_v(unsigned long long, result.physics_temporary_arena_bytes));
+                fprintf(output, "            \"scratch_overflow_frames\": %u\n", result.scratch_overflow_frame_count);
+            }
+            else {
+                fprintf(output, "\n");
+            }
+            
+            fprintf(output, "        }");
+        }
+    }
+    
+    fprintf(output, "\n    ]\n}\n");
+    
+    if (output != stdout)
+        fclose(output);
+    
+    return 0;
+}
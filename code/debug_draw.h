@@ -0,0 +1,37 @@
+#pragma once
+
+// debug drawing by category, each can be toggled at runtime.
+// draws only go into the immediate render context, the caller flushes it once per frame.
+// with GAME_NO_DEBUG_DRAW defined (headless and release builds) all categories are
+// disabled at compile time and the draw calls are not compiled.
+
+struct Immediate_Render_Context;
+
+enum Debug_Draw_Category {
+    Debug_Draw_Bodies = 0,
+    Debug_Draw_Clones,
+    Debug_Draw_Sweeps,
+    Debug_Draw_Collisions,
+    Debug_Draw_Area_Planes,
+    Debug_Draw_Lights,
+    Debug_Draw_Category_Count,
+};
+
+#define Debug_Draw_All_Categories ((1 << Debug_Draw_Category_Count) - 1)
+
+struct Debug_Draw {
+    Immediate_Render_Context *imc;
+    
+    // bit mask of Debug_Draw_Category
+    u32 categories;
+};
+
+// debug_draw may be null
+inline bool is_debug_draw_enabled(Debug_Draw *debug_draw, Debug_Draw_Category category)
+{
+#if defined(GAME_NO_DEBUG_DRAW)
+    return false;
+#else
+    return debug_draw && (debug_draw->categories & (1 << category));
+#endif
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+// stable storage for entities.
+// entities live in chunks that are never moved, so an entity keeps its slot index
+// and address until it is removed. removed slots go onto a free list and are reused.
+// every add and remove increments the generation of the slot, live slots have odd generations,
+// so handles to removed entities are detected as stale and the null handle (generation 0) never matches.
+// the pool grows one chunk at a time, chunks are only freed with the pool.
+//
+// the data read every frame is stored in hot streams, one array per field,
+// the rest is in Entity (cold), so passes over all entities only stream the bytes they use.
+// access both through an Entity_Slot.
+// include after Entity and Entity_Handle are defined, see game.h.
+
+#define Entity_Pool_Chunk_Capacity  1024
+#define Entity_Pool_Max_Chunk_Count 1024
+#define Entity_Pool_Max_Entity_Count (Entity_Pool_Chunk_Capacity * Entity_Pool_Max_Chunk_Count)
+
+#define Entity_Pool_No_Free_Slot 0xFFFFFFFF
+
+// body index of child entities
+#define Entity_No_Body 0xFFFFFFFF
+
+enum Entity_Transform_Flag {
+    // orientation, rotation axis or scale changed, the rotation has to be rebuilt
+    Entity_Transform_Rotation_Dirty = 1 << 0,
+    
+    // world transform changed in the last update, children have to follow
+    Entity_Transform_World_Changed  = 1 << 1,
+};
+
+struct Entity_Pool_Chunk {
+    u32 generations[Entity_Pool_Chunk_Capacity];
+    
+    // hot streams
+    
+    // root entities have a body in Game_State::bodies, children have Entity_No_Body.
+    // the body owns position and velocity.
+    // bodies are kept packed, so body_index changes when other bodies are removed
+    u32 body_indices[Entity_Pool_Chunk_Capacity];
+    
+    u32 kinds[Entity_Pool_Chunk_Capacity];
+    f32 radii[Entity_Pool_Chunk_Capacity];
+    f32 scales[Entity_Pool_Chunk_Capacity];
+    f32 orientations[Entity_Pool_Chunk_Capacity];
+    f32 angular_velocities[Entity_Pool_Chunk_Capacity];
+    vec3f angular_rotation_axes[Entity_Pool_Chunk_Capacity];
+    
+    // updated by build_draw_lists when flagged, see Entity_Transform_Flag
+    mat4x3f to_world_transforms[Entity_Pool_Chunk_Capacity];
+    u8 transform_flags[Entity_Pool_Chunk_Capacity];
+    
+    // cold data
+    Entity entities[Entity_Pool_Chunk_Capacity];
+    
+    // only valid for free slots
+    u32 next_free_indices[Entity_Pool_Chunk_Capacity];
+};
+
+// where an entity lives, chunk is null for stale handles
+struct Entity_Slot {
+    Entity_Pool_Chunk *chunk;
+    
+    // in chunk
+    u32 index;
+};
+
+struct Entity_Pool {
+    // needs to support free in any order
+    Memory_Allocator *allocator;
+    
+    Entity_Pool_Chunk *chunks[Entity_Pool_Max_Chunk_Count];
+    u32 chunk_count;
+    
+    // slots in [0, slot_count) were used at least once, free or not
+    u32 slot_count;
+    
+    // live entities
+    u32 count;
+    
+    u32 first_free_index;
+};
+
+inline bool is_null(Entity_Handle handle)
+{
+    return !handle.generation;
+}
+
+inline bool operator==(Entity_Handle a, Entity_Handle b)
+{
+    return (a.index == b.index) && (a.generation == b.generation);
+}
+
+inline bool operator!=(Entity_Handle a, Entity_Handle b)
+{
+    return !(a == b);
+}
+
+void add_entity_pool_chunk(Entity_Pool *pool)
+{
+    assert(pool->chunk_count < Entity_Pool_Max_Chunk_Count);
+    
+    auto chunk = ALLOCATE(pool->allocator, Entity_Pool_Chunk);
+    
+    // generation 0 is free and never was live
+    for (u32 i = 0; i < Entity_Pool_Chunk_Capacity; ++i)
+        chunk->generations[i] = 0;
+    
+    pool->chunks[pool->chunk_count++] = chunk;
+}
+
+// reserves chunks for at least capacity entities,
+// allocator has to support free in any order, not a stack allocator
+void init_entity_pool(Entity_Pool *pool, Memory_Allocator *allocator, u32 capacity)
+{
+    *pool = {};
+    pool->allocator = allocator;
+    pool->first_free_index = Entity_Pool_No_Free_Slot;
+    
+    u32 chunk_count = MAX(1, (capacity + Entity_Pool_Chunk_Capacity - 1) / Entity_Pool_Chunk_Capacity);
+    for (u32 i = 0; i < chunk_count; ++i)
+        add_entity_pool_chunk(pool);
+}
+
+// adds chunks up front, so count more entities can be added without growing
+void reserve_entities(Entity_Pool *pool, u32 count)
+{
+    u32 capacity = pool->count + count;
+    assert(capacity <= Entity_Pool_Max_Entity_Count);
+    
+    while (pool->chunk_count * Entity_Pool_Chunk_Capacity < capacity)
+        add_entity_pool_chunk(pool);
+}
+
+void free_entity_pool(Entity_Pool *pool)
+{
+    while (pool->chunk_count)
+        free(pool->allocator, pool->chunks[--pool->chunk_count]);
+    
+    *pool = {};
+}
+
+// removes all entities, keeps the chunks.
+// generations are kept, so handles from before the clear stay stale
+void clear_entity_pool(Entity_Pool *pool)
+{
+    for (u32 index = 0; index < pool->slot_count; ++index) {
+        auto chunk = pool->chunks[index / Entity_Pool_Chunk_Capacity];
+        u32 slot = index % Entity_Pool_Chunk_Capacity;
+        
+        if (chunk->generations[slot] & 1)
+            ++chunk->generations[slot];
+    }
+    
+    // free list in index order, so the next entities get the same slots as after init
+    pool->first_free_index = Entity_Pool_No_Free_Slot;
+    for (u32 index = pool->slot_count; index > 0; --index) {
+        auto chunk = pool->chunks[(index - 1) / Entity_Pool_Chunk_Capacity];
+        chunk->next_free_indices[(index - 1) % Entity_Pool_Chunk_Capacity] = pool->first_free_index;
+        pool->first_free_index = index - 1;
+    }
+    
+    pool->count = 0;
+}
+
+inline bool is_live(Entity_Slot slot)
+{
+    return slot.chunk && (slot.chunk->generations[slot.index] & 1);
+}
+
+// also for free slots, check with is_live
+inline Entity_Slot get_entity_slot(Entity_Pool *pool, u32 index)
+{
+    assert(index < pool->slot_count);
+    
+    Entity_Slot slot;
+    slot.chunk = pool->chunks[index / Entity_Pool_Chunk_Capacity];
+    slot.index = index % Entity_Pool_Chunk_Capacity;
+    
+    return slot;
+}
+
+// chunk is null if handle is null or stale
+inline Entity_Slot get_entity_slot(Entity_Pool *pool, Entity_Handle handle)
+{
+    if (handle.index >= pool->slot_count)
+        return {};
+    
+    Entity_Slot slot = get_entity_slot(pool, handle.index);
+    
+    if (slot.chunk->generations[slot.index] != handle.generation)
+        return {};
+    
+    return slot;
+}
+
+// cold data, null if the slot is free
+inline Entity * get_entity(Entity_Pool *pool, u32 index)
+{
+    Entity_Slot slot = get_entity_slot(pool, index);
+    
+    if (!is_live(slot))
+        return null;
+    
+    return slot.chunk->entities + slot.index;
+}
+
+// cold data, null if handle is null or stale
+inline Entity * get_entity(Entity_Pool *pool, Entity_Handle handle)
+{
+    Entity_Slot slot = get_entity_slot(pool, handle);
+    
+    if (!slot.chunk)
+        return null;
+    
+    return slot.chunk->entities + slot.index;
+}
+
+// index has to be live
+inline Entity_Handle get_entity_handle(Entity_Pool *pool, u32 index)
+{
+    assert(get_entity(pool, index));
+    
+    Entity_Handle handle;
+    handle.index = index;
+    handle.generation = pool->chunks[index / Entity_Pool_Chunk_Capacity]->generations[index % Entity_Pool_Chunk_Capacity];
+    
+    return handle;
+}
+
+// returns a zero initialized entity without body, grows the pool if all slots are live
+Entity_Handle add_entity(Entity_Pool *pool)
+{
+    u32 index;
+    
+    if (pool->first_free_index != Entity_Pool_No_Free_Slot) {
+        index = pool->first_free_index;
+        pool->first_free_index = pool->chunks[index / Entity_Pool_Chunk_Capacity]->next_free_indices[index % Entity_Pool_Chunk_Capacity];
+    }
+    else {
+        if (pool->slot_count == pool->chunk_count * Entity_Pool_Chunk_Capacity)
+            add_entity_pool_chunk(pool);
+        
+        index = pool->slot_count++;
+    }
+    
+    auto chunk = pool->chunks[index / Entity_Pool_Chunk_Capacity];
+    u32 slot = index % Entity_Pool_Chunk_Capacity;
+    
+    assert(!(chunk->generations[slot] & 1));
+    ++chunk->generations[slot];
+    
+    chunk->body_indices[slot]          = Entity_No_Body;
+    chunk->kinds[slot]                 = 0;
+    chunk->radii[slot]                 = 0.0f;
+    chunk->scales[slot]                = 0.0f;
+    chunk->orientations[slot]          = 0.0f;
+    chunk->angular_velocities[slot]    = 0.0f;
+    chunk->angular_rotation_axes[slot] = {};
+    chunk->to_world_transforms[slot]   = {};
+    chunk->transform_flags[slot]       = Entity_Transform_Rotation_Dirty;
+    chunk->entities[slot]              = {};
+    
+    ++pool->count;
+    
+    Entity_Handle handle;
+    handle.index = index;
+    handle.generation = chunk->generations[slot];
+    
+    return handle;
+}
+
+// the slot is reused by a later add_entity, other entities are not moved
+void remove_entity(Entity_Pool *pool, u32 index)
+{
+    assert(get_entity(pool, index));
+    
+    auto chunk = pool->chunks[index / Entity_Pool_Chunk_Capacity];
+    u32 slot = index % Entity_Pool_Chunk_Capacity;
+    
+    ++chunk->generations[slot];
+    chunk->next_free_indices[slot] = pool->first_free_index;
+    pool->first_free_index = index;
+    
+    --pool->count;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// rolling frame time recorder, averages hide single slow frames,
+// so the last Frame_Stats_Sample_Count frames are kept and reported as percentiles.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define Frame_Stats_Sample_Count 512
+
+enum Frame_Stat {
+    Frame_Stat_Frame_Milliseconds,
+    Frame_Stat_Physics_Milliseconds,
+    Frame_Stat_Physics_Step_Count,
+    Frame_Stat_Count,
+};
+
+struct Frame_Stats {
+    f32 samples[Frame_Stat_Count][Frame_Stats_Sample_Count];
+    
+    // ring buffer, oldest sample is at next_index once count is Frame_Stats_Sample_Count
+    u32 next_index;
+    u32 count;
+    
+    // total recorded frames, for the csv
+    u32 frame_count;
+};
+
+struct Frame_Stat_Percentiles {
+    f32 p50;
+    f32 p95;
+    f32 p99;
+    f32 max;
+};
+
+void record_frame_stats(Frame_Stats *stats, f32 frame_milliseconds, f32 physics_milliseconds, u32 physics_step_count)
+{
+    stats->samples[Frame_Stat_Frame_Milliseconds][stats->next_index]   = frame_milliseconds;
+    stats->samples[Frame_Stat_Physics_Milliseconds][stats->next_index] = physics_milliseconds;
+    stats->samples[Frame_Stat_Physics_Step_Count][stats->next_index]   = physics_step_count;
+    
+    stats->next_index = (stats->next_index + 1) % Frame_Stats_Sample_Count;
+    stats->count = MIN(stats->count + 1, Frame_Stats_Sample_Count);
+    ++stats->frame_count;
+}
+
+// i = 0 is the oldest sample
+inline f32 get_frame_stat_sample(Frame_Stats *stats, Frame_Stat stat, u32 i)
+{
+    assert(i < stats->count);
+    
+    u32 first_index = (stats->next_index + Frame_Stats_Sample_Count - stats->count) % Frame_Stats_Sample_Count;
+    
+    return stats->samples[stat][(first_index + i) % Frame_Stats_Sample_Count];
+}
+
+int compare_f32(const void *a, const void *b)
+{
+    f32 value_a = *cast_p(const f32, a);
+    f32 value_b = *cast_p(const f32, b);
+    
+    if (value_a < value_b)
+        return -1;
+    
+    return (value_a > value_b);
+}
+
+// nearest rank: the smallest sample with at least percent of all samples at or below it,
+// index ceil(percent * count / 100) - 1
+inline u32 get_nearest_rank_index(u32 count, u32 percent)
+{
+    u32 rank = (percent * count + 99) / 100;
+    
+    return CLAMP(rank, 1u, count) - 1;
+}
+
+// nearest rank percentiles over the recorded samples, all 0 without samples
+Frame_Stat_Percentiles get_frame_stat_percentiles(Frame_Stats *stats, Frame_Stat stat)
+{
+    Frame_Stat_Percentiles percentiles = {};
+    
+    if (!stats->count)
+        return percentiles;
+    
+    f32 sorted[Frame_Stats_Sample_Count];
+    COPY(sorted, stats->samples[stat], sizeof(f32) * stats->count);
+    qsort(sorted, stats->count, sizeof(f32), compare_f32);
+    
+    percentiles.p50 = sorted[get_nearest_rank_index(stats->count, 50)];
+    percentiles.p95 = sorted[get_nearest_rank_index(stats->count, 95)];
+    percentiles.p99 = sorted[get_nearest_rank_index(stats->count, 99)];
+    percentiles.max = sorted[stats->count - 1];
+    
+    return percentiles;
+}
+
+// writes the recorded samples, oldest first
+bool write_frame_stats_csv(Frame_Stats *stats, const char *file_path)
+{
+    FILE *file = fopen(file_path, "w");
+    if (!file)
+        return false;
+    
+    defer { fclose(file); };
+    
+    fprintf(file, "frame,frame ms,physics ms,physics steps\n");
+    
+    u32 first_frame = stats->frame_count - stats->count;
+    for (u32 i = 0; i < stats->count; ++i)
+        fprintf(file, "%u,%.3f,%.3f,%u\n", first_frame + i, get_frame_stat_sample(stats, Frame_Stat_Frame_Milliseconds, i), get_frame_stat_sample(stats, Frame_Stat_Physics_Milliseconds, i), cast_v(u32, get_frame_stat_sample(stats, Frame_Stat_Physics_Step_Count, i)));
+    
+    return !ferror(file);
+}
+
+#if !defined(GAME_NO_DEBUG_DRAW)
+
+// samples from left (oldest) to right, scaled so the max fits into size.y,
+// with lines at p50 (green), p95 (yellow) and p99 (red)
+void draw_frame_stat_graph(Immediate_Render_Context *imc, Frame_Stats *stats, Frame_Stat stat, vec3f bottom_left, vec3f size, rgba32 color)
+{
+    draw_rect(imc, bottom_left, vec3f{ size.x }, vec3f{ 0, size.y * 0.02f }, rgba32{ 255, 255, 255, 255 });
+    
+    if (stats->count < 2)
+        return;
+    
+    Frame_Stat_Percentiles percentiles = get_frame_stat_percentiles(stats, stat);
+    
+    f32 scale = size.y / MAX(percentiles.max, 0.001f);
+    f32 step  = size.x / (Frame_Stats_Sample_Count - 1);
+    
+    vec3f last_point = bottom_left + vec3f{ 0, get_frame_stat_sample(stats, stat, 0) * scale };
+    for (u32 i = 1; i < stats->count; ++i) {
+        vec3f point = bottom_left + vec3f{ i * step, get_frame_stat_sample(stats, stat, i) * scale };
+        draw_line(imc, last_point, point, color);
+        last_point = point;
+    }
+    
+    draw_line(imc, bottom_left + vec3f{ 0, percentiles.p50 * scale }, bottom_left + vec3f{ size.x, percentiles.p50 * scale }, rgba32{ 0, 255, 0, 255 });
+    draw_line(imc, bottom_left + vec3f{ 0, percentiles.p95 * scale }, bottom_left + vec3f{ size.x, percentiles.p95 * scale }, rgba32{ 255, 255, 0, 255 });
+    draw_line(imc, bottom_left + vec3f{ 0, percentiles.p99 * scale }, bottom_left + vec3f{ size.x, percentiles.p99 * scale }, rgba32{ 255, 0, 0, 255 });
+}
+
+#endif
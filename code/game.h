@@ -0,0 +1,1257 @@
+#pragma once
+
+// game simulation shared by the windowed application (main.cpp)
+// and the headless runner (headless_main.cpp).
+// needs geometry.h, template_array.h and a memory allocator.
+// define GAME_NO_DEBUG_DRAW if there is no immediate render context,
+// otherwise immediate_render.h has to be included before, see debug_draw.h.
+
+struct Mesh;
+struct Immediate_Render_Context;
+struct Ship_Entity;
+
+enum Entity_Kind {
+    Ship_Kind = 0,
+    Asteroid_Kind,
+    Bullet_Kind,
+    Entity_Kind_Count,
+};
+
+// which kinds collide, has to be symmetric
+constexpr bool Collision_Matrix[Entity_Kind_Count][Entity_Kind_Count] = {
+    //                Ship,  Asteroid, Bullet
+    /* Ship     */ {  false, true,     false },
+    /* Asteroid */ {  true,  true,     true  },
+    /* Bullet   */ {  false, true,     false },
+};
+
+// which collisions reflect velocities, has to be symmetric
+constexpr bool Reflection_Matrix[Entity_Kind_Count][Entity_Kind_Count] = {
+    //                Ship,  Asteroid, Bullet
+    /* Ship     */ {  true,  true,     false },
+    /* Asteroid */ {  true,  true,     false },
+    /* Bullet   */ {  false, false,    false },
+};
+
+#include "physics.h"
+#include "random.h"
+#include "debug_draw.h"
+#include "transform_batch.h"
+#include "poisson_disk.h"
+
+// refers to an entity in Game_State::entities,
+// stays valid while the entity is alive, see entity_pool.h
+struct Entity_Handle {
+    u32 index;
+    u32 generation;
+};
+
+// the cold entity data,
+// transform, motion, radius and kind are in the hot streams of Entity_Pool_Chunk
+struct Entity {
+    vec4 diffuse_color;
+    vec4 specular_color;
+    bool is_light;
+    Mesh *mesh;
+    Ship_Entity *ship;
+    
+    u32 hp;
+};
+
+struct Ship_Entity {
+    Entity_Handle entity;
+    f32 thruster_intensity;
+};
+
+struct Draw_Entity {
+    mat4x3f to_world_transform;
+    Mesh *mesh;
+    vec4f color;
+    f32 shininess;
+};
+
+// per instance vertex attributes of the phong shader with WITH_INSTANCING,
+// the layout has to match the attribute pointers in main.cpp
+struct Draw_Instance {
+    mat4x3f to_world_transform;
+    vec4f diffuse_color;
+    f32 shininess;
+};
+
+// consecutive instances with the same mesh, drawn with one instanced draw call
+struct Draw_Instance_Group {
+    Mesh *mesh;
+    u32 first_instance;
+    u32 instance_count;
+};
+
+struct Light_Entity {
+    vec3f world_position;
+    vec4f diffuse_color;
+    vec4f specular_color;
+    f32   attenuation;
+    
+    // no light beyond it, bounds the clusters the light is assigned to
+    f32   radius;
+};
+
+#include "entity_pool.h"
+#include "transform_hierarchy.h"
+
+// entities and bodies are reserved with this capacity,
+// unless init_game is told otherwise. both grow when needed
+#define Initial_Entity_Capacity 1024
+
+#define Default_Physics_Hz 120
+
+// bounds the simulation cost per frame, even at high game speed
+#define Max_Physics_Catch_Up_Step_Count 8
+
+// asteroid radius is its scale
+#define Asteroid_Spawn_Scale 3.0f
+
+// asteroids spawn at least this far from the ship center
+#define Asteroid_Spawn_Ship_Clearance 10.0f
+
+// extra gap between spawned asteroids
+#define Asteroid_Spawn_Margin 0.5f
+
+#define Template_Array_Type      Draw_Entity_Buffer
+#define Template_Array_Data_Type Draw_Entity
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+#define Template_Array_Type      Draw_Instance_Buffer
+#define Template_Array_Data_Type Draw_Instance
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+#define Template_Array_Type      Draw_Instance_Group_Buffer
+#define Template_Array_Data_Type Draw_Instance_Group
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+#define Template_Array_Type      Light_Entity_Buffer
+#define Template_Array_Data_Type Light_Entity
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+// keys the game reacts to, one bit each in Frame_Input
+enum Game_Key {
+    Game_Key_Accelerate = 0,
+    Game_Key_Rotate_Left,
+    Game_Key_Rotate_Right,
+    Game_Key_Fire,
+    
+    // debug camera, also moved with Accelerate, Rotate_Left and Rotate_Right
+    Game_Key_Camera_Backward,
+    Game_Key_Camera_Down,
+    Game_Key_Camera_Up,
+    
+    Game_Key_Toggle_Debug_Mode,
+    Game_Key_Toggle_Pause,
+    Game_Key_Toggle_Debug_Game_Controls,
+    Game_Key_Slower,
+    Game_Key_Faster,
+    Game_Key_Toggle_Game_Speed,
+    Game_Key_Toggle_Broadphase,
+    Game_Key_Unlimited_Physics_Steps,
+    Game_Key_Fewer_Physics_Steps,
+    Game_Key_More_Physics_Steps,
+    Game_Key_Toggle_Multithreading,
+    
+    Game_Key_Count,
+};
+
+// everything a frame reads from the player,
+// recorded as is for replays
+struct Frame_Input {
+    // real time, before game speed is applied
+    f32 delta_seconds;
+    
+    u32 active_keys;
+    u32 pressed_keys;
+};
+
+bool is_active(Frame_Input input, Game_Key key) {
+    return (input.active_keys >> key) & 1;
+}
+
+bool was_pressed(Frame_Input input, Game_Key key) {
+    return (input.pressed_keys >> key) & 1;
+}
+
+// settings changed by keys while playing
+struct Game_Options {
+    f32 game_speed;
+    f32 backup_game_speed;
+    
+    bool pause_game;
+    bool in_debug_mode;
+    bool debug_use_game_controls;
+    
+    // 0 is unlimited
+    u32 max_physics_step_count;
+    
+    // grid broadphase or testing all pairs, both find the same collisions
+    bool use_brute_force_broadphase;
+    
+    // results are the same for any worker count
+    bool use_multithreaded_narrowphase;
+};
+
+// one frame of ship input, from the keyboard or a scripted source
+struct Ship_Controls {
+    bool accelerate;
+    bool start_accelerating;
+    bool fire;
+    
+    // counter clockwise is positive
+    f32 rotation;
+};
+
+struct Game_State {
+    Random_Generator random;
+    Game_Options options;
+    
+    // supports free in any order, entity chunks, bodies and
+    // the physics scratch arenas grow from it
+    Memory_Allocator *allocator;
+    
+    Entity_Pool entities;
+    Body_Buffer bodies;
+    
+    // entities without body attached to other entities
+    Transform_Hierarchy transform_hierarchy;
+    
+    f32 physics_timestep;
+    f32 physics_time_accumulator;
+    
+    // applied once per simulation step, see set_ship_controls
+    Ship_Controls ship_controls;
+    
+    Ship_Entity ship;
+    Entity_Handle ship_thrusters;
+    
+    // all memory of update_physics, see physics.h
+    Scratch_Arena physics_arena;
+    Scratch_Arena physics_temporary_arena;
+    
+    // not owned, null in headless runs
+    Mesh *ship_mesh;
+    Mesh *asteroid_mesh;
+    Mesh *beam_mesh;
+};
+
+struct Physics_Settings {
+    f32 margin;
+    
+    // 0 is unlimited
+    u32 max_physics_step_count;
+    
+    bool use_brute_force_broadphase;
+    u32 narrowphase_worker_count;
+};
+
+vec3f random_unit_vector(Random_Generator *generator, bool random_x = true, bool random_y = true, bool random_z = true) {
+    vec3f result;
+    
+    if (random_x)
+        result.x = random_f32(generator, -1.0f, 1.0f);
+    else
+        result.x = 0.0f;
+    
+    if (random_y)
+        result.y = random_f32(generator, -1.0f, 1.0f);
+    else
+        result.y = 0.0f;
+    
+    if (random_z)
+        result.z = random_f32(generator, -1.0f, 1.0f);
+    else
+        result.z = 0.0f;
+    
+    return normalize_or_zero(result);
+}
+
+// grows game->bodies to at least capacity, do not call while bodies are simulated
+void reserve_bodies(Game_State *game, u32 capacity) {
+    if (capacity <= game->bodies.capacity)
+        return;
+    
+    Body_Buffer bodies = ALLOCATE_ARRAY_INFO(game->allocator, Body, capacity);
+    COPY(bodies.data, game->bodies.data, sizeof(Body) * game->bodies.count);
+    bodies.count = game->bodies.count;
+    
+    free(game->allocator, game->bodies.data);
+    game->bodies = bodies;
+}
+
+// adds the body of a root entity, call after radius and kind are set.
+// grows game->bodies if it is full, so do not call while bodies are simulated
+void add_body(Game_State *game, Entity_Handle entity_handle, vec3f position, vec3f velocity) {
+    Entity_Slot slot = get_entity_slot(&game->entities, entity_handle);
+    assert(slot.chunk && (slot.chunk->body_indices[slot.index] == Entity_No_Body));
+    
+    if (game->bodies.count == game->bodies.capacity)
+        reserve_bodies(game, MAX(game->bodies.capacity * 2, 16));
+    
+    slot.chunk->body_indices[slot.index] = game->bodies.count;
+    
+    u32 kind = slot.chunk->kinds[slot.index];
+    
+    Body *body = push(&game->bodies, {});
+    body->entity_index = entity_handle.index;
+    body->sphere = { position, slot.chunk->radii[slot.index] };
+    body->previous_center = position;
+    body->velocity = velocity;
+    body->kind = kind;
+    body->destroy_on_collision = (kind == Bullet_Kind);
+}
+
+// removes entity and its body, the last body is moved into the gap,
+// the other entities stay where they are.
+// attached children are removed as well
+void remove_entity(Game_State *game, u32 entity_index) {
+    Entity_Slot slot = get_entity_slot(&game->entities, entity_index);
+    assert(is_live(slot));
+    
+    u32 body_index = slot.chunk->body_indices[slot.index];
+    if (body_index != Entity_No_Body) {
+        unordered_remove(&game->bodies, body_index);
+        
+        if (body_index < game->bodies.count) {
+            Entity_Slot moved = get_entity_slot(&game->entities, game->bodies[body_index].entity_index);
+            moved.chunk->body_indices[moved.index] = body_index;
+        }
+    }
+    
+    remove_entity(&game->entities, entity_index);
+    
+    if (game->transform_hierarchy.count)
+        remove_orphaned_transform_nodes(&game->transform_hierarchy, &game->entities);
+}
+
+void spawn_asteroid(Game_State *game, vec3f position, vec3f velocity, f32 scale, vec4f color) {
+    Entity_Handle asteroid_handle = add_entity(&game->entities);
+    Entity_Slot slot = get_entity_slot(&game->entities, asteroid_handle);
+    Entity *asteroid = slot.chunk->entities + slot.index;
+    
+    // separate statements, the evaluation order of arguments and operands is unspecified
+    vec3f asteroid_velocity = random_unit_vector(&game->random, true, true, false);
+    asteroid_velocity *= random_f32(&game->random, 3.0f, 10.0f);
+    
+    asteroid->diffuse_color = color;
+    slot.chunk->kinds[slot.index] = Asteroid_Kind;
+    asteroid->mesh = game->asteroid_mesh;
+    slot.chunk->scales[slot.index] = scale;
+    slot.chunk->radii[slot.index] = scale * 1.0f;
+    
+    slot.chunk->to_world_transforms[slot.index] = MAT4X3_IDENTITY;
+    slot.chunk->to_world_transforms[slot.index].translation = position;
+    slot.chunk->angular_rotation_axes[slot.index] = random_unit_vector(&game->random);
+    slot.chunk->angular_velocities[slot.index] = random_f32(&game->random, 0.0f, 2 * PIf);
+    
+    asteroid->hp = 32;
+    
+    add_body(game, asteroid_handle, position, asteroid_velocity);
+}
+
+// the simulated up direction of the ship, the to world transform is only updated for rendering
+vec3f get_ship_up(Entity_Slot ship) {
+    mat4x3f rotation;
+    set_fast_transform_rotation(&rotation, ship.chunk->angular_rotation_axes[ship.index], ship.chunk->orientations[ship.index], 1.0f);
+    
+    return rotation.up;
+}
+
+// starts at the simulated ship body, not at its interpolated render transform
+void spawn_bullet(Game_State *game) {
+    Entity_Slot ship = get_entity_slot(&game->entities, game->ship.entity);
+    Body *ship_body = game->bodies + ship.chunk->body_indices[ship.index];
+    vec3f ship_up = get_ship_up(ship);
+    
+    Entity_Handle bullet_handle = add_entity(&game->entities);
+    Entity_Slot slot = get_entity_slot(&game->entities, bullet_handle);
+    Entity *bullet = slot.chunk->entities + slot.index;
+    
+    const f32 Bullet_Velocity = 30;
+    
+    bullet->diffuse_color = vec4f{ 0.2f, 0.2f, 1.0f, 1.0f };
+    slot.chunk->kinds[slot.index] = Bullet_Kind;
+    bullet->mesh = game->beam_mesh;
+    slot.chunk->scales[slot.index] = 1.0f;
+    slot.chunk->radii[slot.index] = 1.0f;
+    
+    mat4x3f *transform = slot.chunk->to_world_transforms + slot.index;
+    set_fast_transform_rotation(transform, VEC3_Z_AXIS, ship.chunk->orientations[ship.index], 1.0f);
+    transform->translation = ship_body->sphere.center + ship_up * (ship.chunk->radii[ship.index] * 2);
+    slot.chunk->orientations[slot.index] = ship.chunk->orientations[ship.index];
+    slot.chunk->angular_rotation_axes[slot.index] = VEC3_Z_AXIS;
+    slot.chunk->angular_velocities[slot.index] = 0;
+    
+    add_body(game, bullet_handle, transform->translation, ship_up * Bullet_Velocity);
+}
+
+// removes all entities and makes the ship, the random generator restarts with seed.
+// options are kept. set the mesh pointers before, they are copied into the entities
+void reset_game(Game_State *game, u64 seed) {
+    game->random = make_random_generator(seed);
+    
+    clear_entity_pool(&game->entities);
+    game->bodies.count = 0;
+    game->transform_hierarchy.count = 0;
+    game->physics_time_accumulator = 0.0f;
+    game->ship_controls = {};
+    game->ship = {};
+    
+    game->ship.entity = add_entity(&game->entities);
+    
+    Entity_Slot ship = get_entity_slot(&game->entities, game->ship.entity);
+    Entity *ship_entity = ship.chunk->entities + ship.index;
+    ship_entity->ship = &game->ship;
+    ship_entity->diffuse_color = make_vec4_scale(1.0f);
+    ship_entity->mesh = game->ship_mesh;
+    ship.chunk->scales[ship.index] = 1.0f;
+    ship.chunk->radii[ship.index]  = 1.0f;
+    ship.chunk->angular_rotation_axes[ship.index] = VEC3_Z_AXIS;
+    ship.chunk->angular_velocities[ship.index] = 0;
+    ship.chunk->kinds[ship.index] = Ship_Kind;
+    // will be updated anyway
+    ship.chunk->to_world_transforms[ship.index] = MAT4X3_IDENTITY;
+    
+    add_body(game, game->ship.entity, vec3f{}, vec3f{});
+    
+    // thrusters
+    game->ship_thrusters = add_entity(&game->entities);
+    
+    Entity_Slot thrusters = get_entity_slot(&game->entities, game->ship_thrusters);
+    thrusters.chunk->entities[thrusters.index].is_light = true;
+    // make the radius big to have nicer lighting at border switch,
+    // it is also the light radius
+    thrusters.chunk->radii[thrusters.index] = 30.0f;
+    thrusters.chunk->scales[thrusters.index] = 1.0f;
+    
+    mat4x3f thrusters_local_transform = MAT4X3_IDENTITY;
+    thrusters_local_transform.translation = vec3f{ 0.0f, -2.5f, 0.0f };
+    attach_entity(&game->transform_hierarchy, &game->entities, game->ship_thrusters, game->ship.entity, thrusters_local_transform);
+}
+
+// reserves entities and bodies and sets default options,
+// call start_game or reset_game after.
+// allocator has to support free in any order, entities, bodies and
+// the physics scratch arenas grow from it
+void init_game(Game_State *game, Memory_Allocator *allocator, u32 entity_capacity = Initial_Entity_Capacity) {
+    game->allocator = allocator;
+    
+    init_entity_pool(&game->entities, allocator, entity_capacity);
+    game->bodies = ALLOCATE_ARRAY_INFO(allocator, Body, entity_capacity);
+    init_transform_hierarchy(&game->transform_hierarchy, allocator);
+    
+    init_scratch_arena(&game->physics_arena, allocator);
+    init_scratch_arena(&game->physics_temporary_arena, allocator);
+    
+    game->physics_timestep = 1.0f / Default_Physics_Hz;
+    
+    game->options = {};
+    game->options.game_speed = 1.0f;
+    game->options.backup_game_speed = 1.0f;
+    game->options.max_physics_step_count = 100;
+    game->options.use_multithreaded_narrowphase = true;
+}
+
+// spawns up to count asteroids over game_area, without overlapping each other or the bodies
+// that are already there, and keeps Asteroid_Spawn_Ship_Clearance free around the ship.
+// entities and bodies grow once for all of them, so do not call while bodies are simulated.
+// returns how many fit, fewer than count if the area is full
+u32 spawn_asteroids(Game_State *game, Game_Area game_area, u32 count, f32 scale = Asteroid_Spawn_Scale) {
+    if (!count)
+        return 0;
+    
+    reserve_entities(&game->entities, count);
+    reserve_bodies(game, game->bodies.count + count);
+    
+    Sphere3f *obstacles = ALLOCATE_ARRAY(game->allocator, Sphere3f, MAX(game->bodies.count, 1));
+    defer { free(game->allocator, obstacles); };
+    
+    for (u32 i = 0; i < game->bodies.count; ++i) {
+        obstacles[i] = game->bodies[i].sphere;
+        
+        if (game->bodies[i].kind == Ship_Kind)
+            obstacles[i].radius = MAX(obstacles[i].radius, Asteroid_Spawn_Ship_Clearance);
+    }
+    
+    vec3f *positions = ALLOCATE_ARRAY(game->allocator, vec3f, count);
+    defer { free(game->allocator, positions); };
+    
+    // asteroid radius is scale
+    f32 min_distance = scale * 2.0f + Asteroid_Spawn_Margin;
+    u32 spawn_count = sample_poisson_disk(positions, count, game_area, min_distance, obstacles, game->bodies.count, &game->random, game->allocator);
+    
+    for (u32 i = 0; i < spawn_count; ++i) {
+        vec3f color = random_unit_vector(&game->random) * 0.5f + vec3f{1.0f, 1.0f, 1.0f};
+        
+        spawn_asteroid(game, positions[i], vec3f{ 1.0f, 1.0f, 0.0f }, scale, make_vec4(color));
+    }
+    
+    return spawn_count;
+}
+
+// restarts the game like at application start, returns the number of spawned asteroids
+u32 start_game(Game_State *game, u64 seed, u32 asteroid_count, Game_Area game_area) {
+    reset_game(game, seed);
+    
+    return spawn_asteroids(game, game_area, asteroid_count);
+}
+
+// applies the option keys of a frame, returns the game time to simulate
+f32 apply_option_keys(Game_State *game, Frame_Input input) {
+    Game_Options *options = &game->options;
+    
+    if (was_pressed(input, Game_Key_Slower)) {
+        options->game_speed = MAX(1.0f / 16.0f, options->game_speed * 0.5f);
+        options->backup_game_speed = 1.0f;
+    }
+    
+    if (was_pressed(input, Game_Key_Faster)) {
+        options->game_speed = MIN(128, options->game_speed * 2.0f);
+        options->backup_game_speed = 1.0f;
+    }
+    
+    if (was_pressed(input, Game_Key_Toggle_Game_Speed)) {
+        f32 temp = options->backup_game_speed;
+        options->backup_game_speed = options->game_speed;
+        options->game_speed = temp;
+    }
+    
+    if (was_pressed(input, Game_Key_Toggle_Pause))
+        options->pause_game = !options->pause_game;
+    
+    if (was_pressed(input, Game_Key_Toggle_Debug_Mode))
+        options->in_debug_mode = !options->in_debug_mode;
+    
+    if (options->in_debug_mode && was_pressed(input, Game_Key_Toggle_Debug_Game_Controls))
+        options->debug_use_game_controls = !options->debug_use_game_controls;
+    
+    if (was_pressed(input, Game_Key_Unlimited_Physics_Steps))
+        options->max_physics_step_count = 0;
+    
+    if (options->max_physics_step_count && was_pressed(input, Game_Key_Fewer_Physics_Steps))
+        --options->max_physics_step_count;
+    
+    if (was_pressed(input, Game_Key_More_Physics_Steps))
+        ++options->max_physics_step_count;
+    
+    if (was_pressed(input, Game_Key_Toggle_Broadphase))
+        options->use_brute_force_broadphase = !options->use_brute_force_broadphase;
+    
+    if (was_pressed(input, Game_Key_Toggle_Multithreading))
+        options->use_multithreaded_narrowphase = !options->use_multithreaded_narrowphase;
+    
+    return input.delta_seconds * options->game_speed;
+}
+
+// in debug mode the keys move the camera instead, unless debug_use_game_controls is set
+Ship_Controls get_ship_controls(Game_State *game, Frame_Input input) {
+    Ship_Controls controls = {};
+    
+    if (game->options.in_debug_mode && !game->options.debug_use_game_controls)
+        return controls;
+    
+    controls.accelerate         = is_active(input, Game_Key_Accelerate);
+    controls.start_accelerating = was_pressed(input, Game_Key_Accelerate);
+    controls.fire               = was_pressed(input, Game_Key_Fire);
+    
+    // rotate counter clockwise; mathematically positive
+    if (is_active(input, Game_Key_Rotate_Left))
+        controls.rotation += 1.0f;
+    
+    // rotate clockwise; mathematically negative
+    if (is_active(input, Game_Key_Rotate_Right))
+        controls.rotation -= 1.0f;
+    
+    return controls;
+}
+
+Physics_Settings get_physics_settings(Game_State *game) {
+    Physics_Settings settings;
+    settings.margin = 0.2f;
+    settings.max_physics_step_count = game->options.max_physics_step_count;
+    settings.use_brute_force_broadphase = game->options.use_brute_force_broadphase;
+    
+    settings.narrowphase_worker_count = 1;
+    if (game->options.use_multithreaded_narrowphase)
+        settings.narrowphase_worker_count = get_worker_count();
+    
+    return settings;
+}
+
+// call once per frame while the game is not paused, update_physics applies the controls
+// once per simulation step. presses are kept until a step applied them
+void set_ship_controls(Game_State *game, Ship_Controls controls) {
+    game->ship_controls.accelerate          = controls.accelerate;
+    game->ship_controls.rotation            = controls.rotation;
+    game->ship_controls.start_accelerating |= controls.start_accelerating;
+    game->ship_controls.fire               |= controls.fire;
+}
+
+// one simulation step of ship controls, see update_physics
+void update_ship(Game_State *game, Ship_Controls controls, f32 delta_seconds) {
+    PROFILE_SCOPE("ship input");
+    
+    Ship_Entity *ship = &game->ship;
+    Entity_Slot ship_slot = get_entity_slot(&game->entities, ship->entity);
+    
+    ship->thruster_intensity = MAX(0.0f, ship->thruster_intensity - delta_seconds);
+    
+    f32 accelaration = 0.0f;
+    
+    const f32 Max_Velocity = 20.0f;
+    const f32 Acceleration = 25.0f;
+    const f32 Min_Acceleraton = Acceleration * 0.1f;
+    
+    if (controls.accelerate) {
+        accelaration += Acceleration * delta_seconds;
+        ship->thruster_intensity = MAX(ship->thruster_intensity, 0.5f);
+    }
+    
+    if (controls.start_accelerating) {
+        ship->thruster_intensity = 1.0f;
+        accelaration = MAX(Min_Acceleraton, accelaration);
+    }
+    
+    const f32 Rotation_Speed = 2*PIf;
+    if (controls.rotation != 0.0f) {
+        ship_slot.chunk->orientations[ship_slot.index] = wrap_angle(ship_slot.chunk->orientations[ship_slot.index] + controls.rotation * Rotation_Speed * delta_seconds);
+        ship_slot.chunk->transform_flags[ship_slot.index] |= Entity_Transform_Rotation_Dirty;
+    }
+    
+    vec3f accelaration_vector = get_ship_up(ship_slot) * accelaration;
+    
+    Body *ship_body = game->bodies + ship_slot.chunk->body_indices[ship_slot.index];
+    
+    ship_body->velocity += accelaration_vector;
+    f32 v2 = MIN(squared_length(ship_body->velocity), Max_Velocity * Max_Velocity);
+    
+    ship_body->velocity = normalize_or_zero(ship_body->velocity) * sqrt(v2);
+    
+    if (controls.fire)
+        spawn_bullet(game);
+    
+    // turn thrusters on or off
+    Entity *thrusters = get_entity(&game->entities, game->ship_thrusters);
+    thrusters->is_light = (ship->thruster_intensity > 0);
+    if (thrusters->is_light) {
+        thrusters->diffuse_color  = vec4f{ 1, 1, 1, 1 } * ship->thruster_intensity;
+        thrusters->specular_color = vec4f{ 1, 1, 0, 1 } * ship->thruster_intensity;
+    }
+}
+
+struct Physics_Step_Info {
+    u32 physics_step_count;
+    u32 pair_test_count;
+};
+
+// simulates bodies from time 0 to max_timestep, or less if a collision could not be resolved
+// or max_physics_step_count (0 is unlimited) collisions were resolved.
+// bodies end up at time 0 again, ready for the next step.
+Physics_Step_Info simulate_physics_step(Body_Buffer bodies, Game_Area game_area, f32 max_timestep, f32 margin, u32 max_physics_step_count, bool use_brute_force_broadphase, u32 narrowphase_worker_count, Debug_Draw *debug_draw, Scratch_Arena *arena, Scratch_Arena *temporary_arena)
+{
+    PROFILE_SCOPE("physics step");
+    
+    Scratch_Arena_Mark arena_start = get_scratch_arena_mark(arena);
+    defer { rewind_scratch_arena(arena, arena_start); };
+    
+    // remember the start of the step for render interpolation
+    for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
+        if (body->was_destroyed)
+            continue;
+        
+        body->previous_center = body->sphere.center;
+#if !defined(GAME_NO_DEBUG_DRAW)
+        if (is_debug_draw_enabled(debug_draw, Debug_Draw_Bodies))
+            draw_circle(debug_draw->imc, body->sphere.center, body->sphere.radius, rgba32{ 255, 255, 0, 255 });
+#endif
+    }
+    
+#if !defined(GAME_NO_DEBUG_DRAW)
+    f32 debug_step_with   = 70.0f;
+    f32 debug_step_height = 2.0f;
+    f32 debug_step_x      = -debug_step_with * 0.5f;
+    f32 debug_step_y      = -10.0f;
+    vec3f debug_step_last_mark = vec3f{ debug_step_x, debug_step_y };
+    
+    if (is_debug_draw_enabled(debug_draw, Debug_Draw_Sweeps))
+        draw_rect(debug_draw->imc, vec3f{ debug_step_x, debug_step_y - debug_step_height * 0.5f }, vec3f{ debug_step_with }, vec3f{ 0, debug_step_height }, rgba32{ 255, 255, 255, 255 });
+#endif
+    
+    u32 physics_step_count = 0;
+    u32 pair_test_count = 0;
+    
+    // bodies are simulated from time 0 to end_time,
+    // stopping early if we can not resolve a collision
+    f32 end_time = max_timestep;
+    
+    Broadphase_Grid grid = {};
+    Collision_Event_Array events = {};
+    
+    // for testing all pairs, only kinds that collide are paired
+    Body_Index_Array body_indices_of_kind[Entity_Kind_Count] = {};
+    
+    // schedule initial collisions
+    {
+        PROFILE_SCOPE("initial collisions");
+        
+        Scratch_Arena_Mark temporary_start = get_scratch_arena_mark(temporary_arena);
+        defer { rewind_scratch_arena(temporary_arena, temporary_start); };
+        
+        Body_Collision_Job_Array jobs = {};
+        Body_Index_Array candidate_indices = {};
+        
+        if (use_brute_force_broadphase) {
+            for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
+                if (!body->was_destroyed)
+                    push(&body_indices_of_kind[body->kind], index(bodies, body), arena);
+            }
+            
+            // each body against all later bodies of its kind and all bodies of later kinds it collides with
+            for (u32 kind_a = 0; kind_a < Entity_Kind_Count; ++kind_a) {
+                Body_Index_Array indices_a = body_indices_of_kind[kind_a];
+                
+                for (u32 i = 0; i < indices_a.count; ++i) {
+                    for (u32 kind_b = kind_a; kind_b < Entity_Kind_Count; ++kind_b) {
+                        if (!Collision_Matrix[kind_a][kind_b])
+                            continue;
+                        
+                        Body_Collision_Job job;
+                        job.body_index = indices_a[i];
+                        
+                        if (kind_a == kind_b) {
+                            job.candidate_count   = indices_a.count - i - 1;
+                            job.candidate_indices = indices_a.data + i + 1;
+                        }
+                        else {
+                            job.candidate_count   = body_indices_of_kind[kind_b].count;
+                            job.candidate_indices = body_indices_of_kind[kind_b].data;
+                        }
+                        
+                        if (job.candidate_count)
+                            push(&jobs, job, temporary_arena);
+                    }
+                }
+            }
+        }
+        else {
+            grid = make_broadphase_grid(bodies, game_area, end_time, margin, arena);
+            
+            Body_Pair_Key_Array pair_keys = get_broadphase_pairs(&grid, temporary_arena);
+            
+            for (auto pair_key = first(pair_keys); pair_key != one_past_last(pair_keys); ++pair_key)
+                push(&candidate_indices, second_body_index(*pair_key), temporary_arena);
+            
+            // keys are sorted, so all pairs of one body are next to each other
+            u32 group_start = 0;
+            while (group_start < pair_keys.count) {
+                u32 body_index = first_body_index(pair_keys[group_start]);
+                
+                u32 group_end = group_start + 1;
+                while ((group_end < pair_keys.count) && (first_body_index(pair_keys[group_end]) == body_index))
+                    ++group_end;
+                
+                Body_Collision_Job job;
+                job.body_index        = body_index;
+                job.candidate_count   = group_end - group_start;
+                job.candidate_indices = candidate_indices.data + group_start;
+                
+                push(&jobs, job, temporary_arena);
+                
+                group_start = group_end;
+            }
+        }
+        
+        // candidate indices are complete, so the job pointers stay valid
+        schedule_body_collisions_parallel(&events, bodies, jobs, narrowphase_worker_count, game_area, end_time, margin, &pair_test_count, arena, temporary_arena);
+    }
+    
+    // rest of the step
+    PROFILE_SCOPE("collision response");
+    
+    u32 visit_mark = 0;
+    f32 current_time = 0.0f;
+    
+    while ((!max_physics_step_count || (physics_step_count < max_physics_step_count)) && events.count)
+    {
+        Collision_Event event = pop_collision_event(&events, bodies);
+        
+        if (is_outdated(&event))
+            continue;
+        
+        // everything but the grid and events is only needed for this collision
+        Scratch_Arena_Mark temporary_start = get_scratch_arena_mark(temporary_arena);
+        defer { rewind_scratch_arena(temporary_arena, temporary_start); };
+        
+        // collect all collisions at the same time
+        
+        Collision_Pair_Array collisions = {};
+        push(&collisions, event.pair, temporary_arena);
+        
+        while (events.count && (events[0].time == event.time)) {
+            Collision_Event next_event = pop_collision_event(&events, bodies);
+            
+            if (!is_outdated(&next_event))
+                push(&collisions, next_event.pair, temporary_arena);
+        }
+        
+#if !defined(GAME_NO_DEBUG_DRAW)
+        rgba32 old_timestep_color = make_rgba32(vec3f{ 0, 0, 1 } * (current_time / max_timestep));
+        rgba32 new_timestep_color = make_rgba32(vec3f{ 0, 0, 1 } * (event.time / max_timestep));
+        
+        // draw relative timestep in scale
+        if (is_debug_draw_enabled(debug_draw, Debug_Draw_Sweeps)) {
+            vec3f next_mark = vec3f{ debug_step_x + event.time * debug_step_with / max_timestep, debug_step_y };
+            
+            draw_line(debug_draw->imc, debug_step_last_mark, next_mark, old_timestep_color, true, new_timestep_color);
+            draw_line(debug_draw->imc, next_mark + vec3f{ 0, debug_step_height * 0.5f}, next_mark - vec3f{ 0, debug_step_height * 0.5f}, new_timestep_color);
+            
+            debug_step_last_mark = next_mark;
+        }
+#endif
+        
+        current_time = event.time;
+        
+        bool collision_was_resolved = true;
+        
+        for (auto collision = first(collisions); collision != one_past_last(collisions); ++collision) {
+            for (s32 pair_index = 0; pair_index < 2; ++pair_index)
+                move_body_to_time(collision->body_pair[pair_index], current_time, game_area);
+            
+            vec3f mirror_normal = normalize_or_zero(collision->spheres[0].center - collision->spheres[1].center);
+            
+#if !defined(GAME_NO_DEBUG_DRAW)
+            if (is_debug_draw_enabled(debug_draw, Debug_Draw_Collisions))
+                draw_line(debug_draw->imc, collision->spheres[0].center, collision->spheres[1].center, rgba32{ 255, 255, 0, 255 });
+#endif
+            
+            bool does_reflect = Reflection_Matrix[collision->body_pair[0]->kind][collision->body_pair[1]->kind];
+            u32 reflection_count = 0;
+            
+            for (s32 pair_index = 0; pair_index < 2; ++pair_index) {
+                auto body = collision->body_pair[pair_index];
+                
+                if (body->destroy_on_collision && !body->was_destroyed) {
+                    body->was_destroyed = true;
+                    ++body->version;
+                }
+                
+                // reflect velocity
+                if (does_reflect && (dot(mirror_normal * (pair_index * -2 + 1), body->velocity) < 0)) {
+                    reflection_count++;
+                    
+                    vec3f normalized_velocity = normalize_or_zero(reflect(mirror_normal, body->velocity));
+                    
+                    f32 alpha = acos(dot(VEC3_Y_AXIS, normalized_velocity));
+                    f32 cos_beta = dot(VEC3_X_AXIS, normalized_velocity);
+                    
+                    if (cos_beta > 0)
+                        alpha *= -1;
+                    
+                    body->velocity_accumulated_orientation += alpha;
+                    body->velocity_change_count++;
+                }
+            }
+            
+            if (does_reflect && !reflection_count) {
+#if !defined(GAME_NO_DEBUG_DRAW)
+                if (is_debug_draw_enabled(debug_draw, Debug_Draw_Collisions)) {
+                    draw_circle(debug_draw->imc, collision->body_pair[0]->sphere.center, collision->body_pair[0]->sphere.radius, rgba32{ 255, 0, 0, 255 });
+                    draw_circle(debug_draw->imc, collision->body_pair[1]->sphere.center, collision->body_pair[1]->sphere.radius, rgba32{ 255, 0, 0, 255 });
+                }
+#endif
+                
+                collision_was_resolved = false;
+            }
+        }
+        
+        // apply velocity changes, only changed bodies need new collision events
+        
+        Body_Index_Array changed_body_indices = {};
+        
+        for (auto collision = first(collisions); collision != one_past_last(collisions); ++collision) {
+            for (s32 pair_index = 0; pair_index < 2; ++pair_index) {
+                auto body = collision->body_pair[pair_index];
+                
+                if (!body->velocity_change_count)
+                    continue;
+                
+                mat4x3f rotation = make_transform(make_quat(VEC3_Z_AXIS, body->velocity_accumulated_orientation / body->velocity_change_count));
+                
+                body->velocity = transform_direction(rotation, VEC3_Y_AXIS * length(body->velocity));
+                body->velocity_accumulated_orientation = 0.0f;
+                body->velocity_change_count = 0;
+                ++body->version;
+                
+                push(&changed_body_indices, index(bodies, body), temporary_arena);
+            }
+        }
+        
+        ++physics_step_count;
+        
+        // like the old substep loop, we give up on the rest of the frame
+        if (!collision_was_resolved) {
+            end_time = current_time;
+            break;
+        }
+        
+        // reschedule changed bodies,
+        // pairs of two changed bodies only from the later one
+        for (auto body_index = first(changed_body_indices); body_index != one_past_last(changed_body_indices); ++body_index) {
+            Body *body = bodies + *body_index;
+            
+            if (body->was_destroyed)
+                continue;
+            
+            Body_Index_Array candidates = {};
+            
+            if (use_brute_force_broadphase) {
+                for (u32 kind = 0; kind < Entity_Kind_Count; ++kind) {
+                    if (!Collision_Matrix[body->kind][kind])
+                        continue;
+                    
+                    for (u32 i = 0; i < body_indices_of_kind[kind].count; ++i)
+                        push(&candidates, body_indices_of_kind[kind][i], temporary_arena);
+                }
+            }
+            else {
+                insert_body(&grid, bodies, body, end_time - current_time, margin, arena);
+                
+                ++visit_mark;
+                query_broadphase_candidates(&candidates, &grid, bodies, body, end_time - current_time, margin, visit_mark, temporary_arena);
+            }
+            
+            // drop bodies that were already rescheduled, keep order
+            u32 candidate_count = 0;
+            for (auto candidate_index = first(candidates); candidate_index != one_past_last(candidates); ++candidate_index) {
+                if (!contains_body_index(first(changed_body_indices), body_index, *candidate_index))
+                    candidates[candidate_count++] = *candidate_index;
+            }
+            
+            schedule_body_collisions(&events, bodies, body, candidates.data, candidate_count, game_area, end_time, margin, &pair_test_count, arena, temporary_arena);
+        }
+    }
+    
+    // out of physics steps, bodies can only advance until the last resolved collision,
+    // the rest of the frame is dropped like for an unresolved collision
+    if (events.count && max_physics_step_count && (physics_step_count == max_physics_step_count))
+        end_time = current_time;
+    
+#if !defined(GAME_NO_DEBUG_DRAW)
+    // finish timestep scale
+    if (is_debug_draw_enabled(debug_draw, Debug_Draw_Sweeps)) {
+        rgba32 color = make_rgba32(vec3f{ 0, 0, 1 } * (end_time / max_timestep));
+        vec3f next_mark = vec3f{ debug_step_x + end_time * debug_step_with / max_timestep, debug_step_y };
+        draw_line(debug_draw->imc, debug_step_last_mark, next_mark, color);
+    }
+#endif
+    
+    // move all bodies to the end of the simulated time,
+    // which is the start of the next step
+    for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
+        if (body->was_destroyed)
+            continue;
+        
+#if !defined(GAME_NO_DEBUG_DRAW)
+        vec3f old_center = body->sphere.center;
+#endif
+        move_body_to_time(body, end_time, game_area);
+        
+        body->time = 0.0f;
+        body->visit_mark = 0;
+        
+#if !defined(GAME_NO_DEBUG_DRAW)
+        if (is_debug_draw_enabled(debug_draw, Debug_Draw_Sweeps)) {
+            rgba32 color = make_rgba32(vec3f{ 0, 0, 1 } * (end_time / max_timestep));
+            draw_line(debug_draw->imc, old_center, body->sphere.center, color);
+            draw_circle(debug_draw->imc, body->sphere.center, body->sphere.radius, color);
+        }
+#endif
+    }
+    
+    Physics_Step_Info info;
+    info.physics_step_count = physics_step_count;
+    info.pair_test_count    = pair_test_count;
+    
+    return info;
+}
+
+// fixed step simulation clock:
+// game time is accumulated and simulated in steps of physics_timestep,
+// at most Max_Physics_Catch_Up_Step_Count per frame, the rest is dropped.
+// the ship controls are applied before each step, so the ship does not depend on the frame rate.
+// destroyed bodies and their entities are removed afterwards.
+// call once per frame, the physics scratch arenas are reset and sized
+// by the high-water marks of the last call.
+// returns the sum over all simulated steps.
+Physics_Step_Info update_physics(Game_State *game, Game_Area game_area, f32 delta_seconds, bool pause_game, Physics_Settings settings, Debug_Draw *debug_draw)
+{
+    PROFILE_SCOPE("update physics");
+    
+    reset_scratch_arena(&game->physics_arena);
+    reset_scratch_arena(&game->physics_temporary_arena);
+    
+    f32 max_timestep = game->physics_timestep;
+    u32 simulation_step_count = 0;
+    
+    // Increase timestep in pause mode,
+    // to better visualize movement and collisions.
+    if (pause_game) {
+        max_timestep = 2.0f;
+        simulation_step_count = 1;
+    }
+    else {
+        game->physics_time_accumulator = MIN(game->physics_time_accumulator + delta_seconds, game->physics_timestep * Max_Physics_Catch_Up_Step_Count);
+        
+        while (game->physics_time_accumulator >= game->physics_timestep) {
+            game->physics_time_accumulator -= game->physics_timestep;
+            ++simulation_step_count;
+        }
+    }
+    
+    // bodies are simulated in place,
+    // in pause mode we only visualize the next step and simulate a copy
+    Body_Buffer bodies = game->bodies;
+    
+    // the copy keeps the capacity of game->bodies, but is never pushed to
+    if (pause_game) {
+        bodies.data = ALLOCATE_SCRATCH_ARRAY(&game->physics_arena, Body, bodies.count);
+        COPY(bodies.data, game->bodies.data, sizeof(Body) * bodies.count);
+    }
+    
+    Physics_Step_Info sum = {};
+    
+    for (u32 simulation_step = 0; simulation_step < simulation_step_count; ++simulation_step) {
+        if (!pause_game) {
+            update_ship(game, game->ship_controls, max_timestep);
+            game->ship_controls.start_accelerating = false;
+            game->ship_controls.fire = false;
+            
+            // bullets may have been added
+            bodies = game->bodies;
+        }
+        
+        Physics_Step_Info info = simulate_physics_step(bodies, game_area, max_timestep, settings.margin, settings.max_physics_step_count, settings.use_brute_force_broadphase, settings.narrowphase_worker_count, debug_draw, &game->physics_arena, &game->physics_temporary_arena);
+        
+        sum.physics_step_count += info.physics_step_count;
+        sum.pair_test_count    += info.pair_test_count;
+    }
+    
+    if (!pause_game) {
+        for (u32 body_index = 0; body_index < game->bodies.count;) {
+            if (game->bodies[body_index].was_destroyed)
+                remove_entity(game, game->bodies[body_index].entity_index); // moves the last body to body_index
+            else
+                ++body_index;
+        }
+    }
+    
+    return sum;
+}
+
+// advances the visual rotation of entities and adds draw and light entities,
+// rendered between the last two simulation steps.
+// entities overlapping the game area border are added for each side they are visible.
+// debug_draw may be null.
+void build_draw_lists(Draw_Entity_Buffer *draw_entities, Light_Entity_Buffer *light_entities, Game_State *game, Game_Area game_area, f32 delta_seconds, bool pause_game, Debug_Draw *debug_draw)
+{
+    // includes the wrap copies, a zone per entity would flood the profile
+    PROFILE_SCOPE("build draw lists");
+    
+    vec3f area_size = game_area.size;
+    f32 interpolation_alpha = game->physics_time_accumulator / game->physics_timestep;
+    
+    // update root entities, their translation follows the body,
+    // the rotation is only rebuilt if it changed.
+    // only reads the hot streams, the rotations of each run of
+    // consecutive dirty root slots are built in one batch, see transform_batch.h
+    for (u32 chunk_index = 0; chunk_index < game->entities.chunk_count; ++chunk_index) {
+        Entity_Pool_Chunk *chunk = game->entities.chunks[chunk_index];
+        u32 slot_count = MIN(Entity_Pool_Chunk_Capacity, game->entities.slot_count - MIN(game->entities.slot_count, chunk_index * Entity_Pool_Chunk_Capacity));
+        
+        u32 run_start = 0;
+        for (u32 slot = 0; slot <= slot_count; ++slot) {
+            if ((slot < slot_count) && (chunk->generations[slot] & 1) && (chunk->body_indices[slot] != Entity_No_Body)) {
+                u8 flags = chunk->transform_flags[slot] & ~Entity_Transform_World_Changed;
+                
+                if (!pause_game && (chunk->angular_velocities[slot] != 0.0f)) {
+                    chunk->orientations[slot] = wrap_angle(chunk->orientations[slot] + chunk->angular_velocities[slot] * delta_seconds);
+                    flags |= Entity_Transform_Rotation_Dirty;
+                }
+                
+                vec3f translation = get_interpolated_center(game->bodies + chunk->body_indices[slot], interpolation_alpha, game_area);
+                vec3f *world_translation = &chunk->to_world_transforms[slot].translation;
+                
+                if ((translation.x != world_translation->x) || (translation.y != world_translation->y) || (translation.z != world_translation->z)) {
+                    *world_translation = translation;
+                    flags |= Entity_Transform_World_Changed;
+                }
+                
+                chunk->transform_flags[slot] = flags;
+                
+                if (flags & Entity_Transform_Rotation_Dirty)
+                    continue;
+            }
+            
+            if (run_start < slot) {
+                set_fast_transform_rotations(chunk->to_world_transforms + run_start, chunk->angular_rotation_axes + run_start, chunk->orientations + run_start, chunk->scales + run_start, slot - run_start);
+                
+                for (u32 i = run_start; i < slot; ++i)
+                    chunk->transform_flags[i] = Entity_Transform_World_Changed;
+            }
+            
+            run_start = slot + 1;
+        }
+    }
+    
+    // parents are updated, so all children can follow
+    update_transform_hierarchy(&game->transform_hierarchy, &game->entities);
+    
+    for (u32 entity_index = 0; entity_index < game->entities.slot_count; ++entity_index)
+    {
+        Entity_Slot slot = get_entity_slot(&game->entities, entity_index);
+        if (!is_live(slot))
+            continue;
+        
+        Entity *entity = slot.chunk->entities + slot.index;
+        f32 radius = slot.chunk->radii[slot.index];
+        
+        mat4x3f entity_to_world_transform = slot.chunk->to_world_transforms[slot.index];
+        
+        s32 min_x;
+        s32 max_x;
+        if (entity_to_world_transform.translation.x - radius < area_size.x * -0.5f) {
+            min_x = 0;
+            max_x = min_x + 2;
+        }
+        else if (entity_to_world_transform.translation.x + radius > area_size.x * 0.5f) {
+            min_x = -1;
+            max_x = min_x + 2;
+        }
+        else {
+            min_x = 0;
+            max_x = 1;
+        }
+        
+        s32 min_y;
+        s32 max_y;
+        if ((entity_to_world_transform.translation.y - radius < area_size.y * -0.5f)) {
+            min_y = 0;
+            max_y = min_y + 2;
+        }
+        else if ((entity_to_world_transform.translation.y + radius > area_size.y * 0.5f)) {
+            min_y = -1;
+            max_y = min_y + 2;
+        }
+        else {
+            min_y = 0;
+            max_y = 1;
+        }
+        
+        for (s32 y = min_y; y < max_y; ++y) {
+            for (s32 x = min_x; x < max_x; ++x) {
+                mat4x3f transform = entity_to_world_transform;
+                
+                transform.translation.x += area_size.x * x;
+                transform.translation.y += area_size.y * y;
+                
+#if !defined(GAME_NO_DEBUG_DRAW)
+                if ((x || y) && is_debug_draw_enabled(debug_draw, Debug_Draw_Clones))
+                    draw_circle(debug_draw->imc, transform.translation, radius, rgba32{ 0, 255, 0, 255 });
+#endif
+                
+                if (entity->mesh) {
+                    Draw_Entity draw_entity;
+                    draw_entity.to_world_transform = transform;
+                    draw_entity.mesh = entity->mesh;
+                    draw_entity.color = entity->diffuse_color;
+                    draw_entity.shininess = 128.0f;
+                    push(draw_entities, draw_entity);
+                }
+                
+                if (entity->is_light) {
+                    Light_Entity light_entity;
+                    light_entity.world_position = transform.translation;
+                    
+                    f32 intensity = 1.0f;
+                    
+                    if (light_entity.world_position.x < area_size.x * -0.5f)
+                        intensity *= 1.0f - (area_size.x * -0.5f - light_entity.world_position.x) / radius;
+                    else if (light_entity.world_position.x > area_size.x * 0.5f)
+                        intensity *= 1.0f - (light_entity.world_position.x - area_size.x * 0.5f) / radius;
+                    
+                    if (light_entity.world_position.y < area_size.y * -0.5f)
+                        intensity *= 1.0f - (area_size.y * -0.5f - light_entity.world_position.y) / radius;
+                    else if (light_entity.world_position.y > area_size.y * 0.5f)
+                        intensity *= 1.0f - (light_entity.world_position.y - area_size.y * 0.5f) / radius;
+                    
+#if !defined(GAME_NO_DEBUG_DRAW)
+                    if (is_debug_draw_enabled(debug_draw, Debug_Draw_Lights))
+                        draw_circle(debug_draw->imc, light_entity.world_position, radius * intensity,  make_rgba32(x * 0.5f + 0.5f, 0, y * 0.5f + 0.5f)); // make_rgba32(entity->diffuse_color * intensity));
+#endif
+                    
+                    light_entity.diffuse_color  = entity->diffuse_color  * intensity;
+                    light_entity.specular_color = entity->specular_color * intensity;
+                    light_entity.attenuation    = 0.005f;
+                    light_entity.radius         = radius;
+                    push(light_entities, light_entity);
+                }
+            }
+        }
+    }
+}
+
+// sorts draw entities by mesh into instances, one group per mesh.
+// within a group instances keep the order of draw_entities.
+// instances needs room for all draw entities, groups for all distinct meshes
+void build_draw_instances(Draw_Instance_Buffer *instances, Draw_Instance_Group_Buffer *groups, Draw_Entity_Buffer draw_entities)
+{
+    PROFILE_SCOPE("build draw instances");
+    
+    assert(instances->capacity >= draw_entities.count);
+    
+    instances->count = 0;
+    groups->count = 0;
+    
+    // count instances per mesh, there are only a few meshes
+    for (auto draw_entity = first(draw_entities); draw_entity != one_past_last(draw_entities); ++draw_entity) {
+        u32 group_index = 0;
+        while ((group_index < groups->count) && (groups->data[group_index].mesh != draw_entity->mesh))
+            ++group_index;
+        
+        if (group_index == groups->count)
+            push(groups, { draw_entity->mesh, 0, 0 });
+        
+        ++groups->data[group_index].instance_count;
+    }
+    
+    u32 first_instance = 0;
+    for (u32 i = 0; i < groups->count; ++i) {
+        groups->data[i].first_instance = first_instance;
+        first_instance += groups->data[i].instance_count;
+        
+        // counted up again while scattering
+        groups->data[i].instance_count = 0;
+    }
+    
+    for (auto draw_entity = first(draw_entities); draw_entity != one_past_last(draw_entities); ++draw_entity) {
+        u32 group_index = 0;
+        while (groups->data[group_index].mesh != draw_entity->mesh)
+            ++group_index;
+        
+        Draw_Instance_Group *group = &groups->data[group_index];
+        Draw_Instance *instance = instances->data + group->first_instance + group->instance_count++;
+        instance->to_world_transform = draw_entity->to_world_transform;
+        instance->diffuse_color      = draw_entity->color;
+        instance->shininess          = draw_entity->shininess;
+    }
+    
+    instances->count = draw_entities.count;
+}
@@ -0,0 +1,312 @@
+// headless simulation runner, for profiling and soak tests without window or gl.
+// runs the same ship update, physics and draw list building as application_main_loop,
+// with scripted ship controls and a fixed frame delta, or plays back a replay.
+//
+// usage: headless [-asteroids count] [-seed seed] [-frames count] [-delta seconds] [-workers count] [-broadphase grid|brute] [-replay file] [-trace file]
+//
+// a replay brings its own seed, asteroid count, frames and deltas.
+// without -workers the recorded multithreading toggle decides, same for -broadphase and the broadphase toggle.
+// -trace writes the profile zones as chrome trace json at exit, needs PROFILER_ENABLED.
+//
+// prints one line per frame:
+// frame, frame time in ms, physics steps, pair tests, body count, draw entities, render commands
+// and percentiles over the last Frame_Stats_Sample_Count frames at the end.
+// the body state hash at the end is equal for runs that simulated bit identically.
+
+#include <memory_growing_stack.h>
+#include <memory_c_allocator.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#define Template_Geometry_Dimension_Count 3
+#include "geometry.h"
+
+// no immediate render context without gl
+#define GAME_NO_DEBUG_DRAW
+#include "game.h"
+#include "render_commands.h"
+#include "replay.h"
+#include "frame_stats.h"
+
+// matches the game area of the windowed application,
+// a 60 degree field of view at 80 units distance with 16:9 aspect ratio
+#define Headless_Area_Height (2.0f * 80.0f * 0.57735027f)
+#define Headless_Area_Width  (Headless_Area_Height * 16.0f / 9.0f)
+
+struct Headless_Options {
+    u32 asteroid_count;
+    u64 seed;
+    u32 frame_count;
+    f32 delta_seconds;
+    
+    // 0 uses the game options
+    u32 worker_count;
+    
+    // "grid" or "brute", null uses the game options
+    const char *broadphase;
+    
+    const char *replay_path;
+    const char *trace_path;
+};
+
+bool parse_options(Headless_Options *options, int argument_count, char **arguments) {
+    for (int i = 1; i < argument_count; ++i) {
+        // all options have a value
+        if (i + 1 == argument_count) {
+            printf("missing value for option %s\n", arguments[i]);
+            return false;
+        }
+        
+        char *value = arguments[i + 1];
+        
+        if (!strcmp(arguments[i], "-asteroids"))
+            options->asteroid_count = strtoul(value, null, 10);
+        else if (!strcmp(arguments[i], "-seed"))
+            options->seed = strtoull(value, null, 10);
+        else if (!strcmp(arguments[i], "-frames"))
+            options->frame_count = strtoul(value, null, 10);
+        else if (!strcmp(arguments[i], "-delta"))
+            options->delta_seconds = strtof(value, null);
+        else if (!strcmp(arguments[i], "-workers"))
+            options->worker_count = CLAMP(strtoul(value, null, 10), 1, Max_Worker_Count);
+        else if (!strcmp(arguments[i], "-broadphase")) {
+            if (strcmp(value, "grid") && strcmp(value, "brute")) {
+                printf("unknown broadphase %s, use grid or brute\n", value);
+                return false;
+            }
+            
+            options->broadphase = value;
+        }
+        else if (!strcmp(arguments[i], "-replay"))
+            options->replay_path = value;
+        else if (!strcmp(arguments[i], "-trace"))
+            options->trace_path = value;
+        else {
+            printf("unknown option %s\n", arguments[i]);
+            return false;
+        }
+        
+        ++i;
+    }
+    
+    // leave room for bullets
+    if (options->asteroid_count > Entity_Pool_Max_Entity_Count / 2) {
+        printf("-asteroids can be at most %u\n", Entity_Pool_Max_Entity_Count / 2);
+        return false;
+    }
+    
+    if (options->delta_seconds <= 0.0f) {
+        printf("-delta has to be positive\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// deterministic stand-in for the keyboard:
+// thrust in bursts, steer in slow turns and fire twice per second
+Frame_Input get_scripted_frame_input(u32 frame, f32 delta_seconds) {
+    f32 time = frame * delta_seconds;
+    f32 last_time = time - delta_seconds;
+    
+    Frame_Input input = {};
+    input.delta_seconds = delta_seconds;
+    
+    u32 thrust_phase = cast_v(u32, time / 0.75f);
+    
+    if (thrust_phase % 2 == 0) {
+        input.active_keys |= 1 << Game_Key_Accelerate;
+        
+        if (!frame || (thrust_phase != cast_v(u32, last_time / 0.75f)))
+            input.pressed_keys |= 1 << Game_Key_Accelerate;
+    }
+    
+    if (cast_v(u32, time / 2.0f) % 2)
+        input.active_keys |= 1 << Game_Key_Rotate_Left;
+    else
+        input.active_keys |= 1 << Game_Key_Rotate_Right;
+    
+    if (!frame || (cast_v(u32, time * 2.0f) != cast_v(u32, last_time * 2.0f))) {
+        input.active_keys  |= 1 << Game_Key_Fire;
+        input.pressed_keys |= 1 << Game_Key_Fire;
+    }
+    
+    return input;
+}
+
+int main(int argument_count, char **arguments) {
+    Headless_Options options;
+    options.asteroid_count = 16;
+    options.seed = 0;
+    options.frame_count = 600;
+    options.delta_seconds = 1.0f / 60.0f;
+    options.worker_count = 0;
+    options.broadphase = null;
+    options.replay_path = null;
+    options.trace_path = null;
+    
+    if (!parse_options(&options, argument_count, arguments))
+        return 1;
+    
+    init_memory_growing_stack_allocators();
+    
+    // the platform allocator of win32_platform.cpp, without the window
+    auto root_memory = make_c_allocator();
+    auto persistent_memory = make_growing_stack_allocator(&root_memory.allocator);
+    auto transient_memory  = make_growing_stack_allocator(&root_memory.allocator);
+    
+    Game_State game = {};
+    init_game(&game, &root_memory.allocator);
+    
+    // stand-ins without gl, only compared by address, so draw lists and instance groups
+    // are built like with the real meshes
+    static u8 stand_in_meshes[3];
+    game.ship_mesh     = cast_p(Mesh, stand_in_meshes + 0);
+    game.asteroid_mesh = cast_p(Mesh, stand_in_meshes + 1);
+    game.beam_mesh     = cast_p(Mesh, stand_in_meshes + 2);
+    
+    // recorded like in main.cpp, without submitting
+    static Render_Command_List render_commands;
+    init_render_command_list(&render_commands, &root_memory.allocator);
+    
+    Game_Area game_area = { vec3f{ Headless_Area_Width * -0.5f, Headless_Area_Height * -0.5f, 0.0f }, vec3f{ Headless_Area_Width, Headless_Area_Height, 0.0f } };
+    
+    Replay_Player replay = {};
+    defer { free_replay(&replay, &persistent_memory.allocator); };
+    
+    if (options.replay_path) {
+        if (!load_replay(&replay, options.replay_path, &persistent_memory.allocator)) {
+            printf("could not load replay %s\n", options.replay_path);
+            return 1;
+        }
+        
+        options.seed = replay.header.seed;
+        options.asteroid_count = replay.header.asteroid_count;
+        options.frame_count = replay.header.frame_count;
+        game_area = replay.header.game_area;
+        game.options = replay.header.options;
+    }
+    
+    u32 spawn_count = start_game(&game, options.seed, options.asteroid_count, game_area);
+    
+    if (options.replay_path)
+        printf("replay: %s ", options.replay_path);
+    
+    printf("asteroids: %u seed: %llu frames: %u workers: %u\n", options.asteroid_count, cast_v(unsigned long long, options.seed), options.frame_count, options.worker_count);
+    
+    if (spawn_count < options.asteroid_count)
+        printf("only %u asteroids fit into the game area\n", spawn_count);
+    
+    printf("frame, ms, physics steps, pair tests, bodies, draw entities, render commands\n");
+    
+    f64 total_milliseconds = 0.0;
+    f64 max_milliseconds = 0.0;
+    
+    static Frame_Stats frame_stats;
+    
+    for (u32 frame = 0; frame < options.frame_count; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        
+        PROFILE_SCOPE("frame");
+        
+        clear(&transient_memory.memory_growing_stack);
+        
+        Frame_Input input;
+        if (options.replay_path)
+            next_replay_frame(&replay, &input);
+        else
+            input = get_scripted_frame_input(frame, options.delta_seconds);
+        
+        f32 delta_seconds = apply_option_keys(&game, input);
+        bool pause_game = game.options.pause_game;
+        
+        if (!pause_game)
+            set_ship_controls(&game, get_ship_controls(&game, input));
+        
+        Physics_Settings physics_settings = get_physics_settings(&game);
+        
+        if (options.worker_count)
+            physics_settings.narrowphase_worker_count = options.worker_count;
+        
+        if (options.broadphase)
+            physics_settings.use_brute_force_broadphase = !strcmp(options.broadphase, "brute");
+        
+        auto physics_start = std::chrono::steady_clock::now();
+        
+        Physics_Step_Info physics_info = update_physics(&game, game_area, delta_seconds, pause_game, physics_settings, null);
+        
+        f32 physics_milliseconds = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - physics_start).count();
+        
+        Draw_Entity_Buffer  draw_entities  = ALLOCATE_ARRAY_INFO(&transient_memory.allocator, Draw_Entity, game.entities.count * 4);
+        defer { free(&transient_memory.allocator, draw_entities.data); };
+        
+        // one per draw entity at most
+        Light_Entity_Buffer light_entities = ALLOCATE_ARRAY_INFO(&transient_memory.allocator, Light_Entity, game.entities.count * 4);
+        defer { free(&transient_memory.allocator, light_entities.data); };
+        
+        build_draw_lists(&draw_entities, &light_entities, &game, game_area, delta_seconds, pause_game, null);
+        
+        // what main.cpp uploads and draws, one draw call per group
+        Draw_Instance_Buffer instances = ALLOCATE_ARRAY_INFO(&transient_memory.allocator, Draw_Instance, draw_entities.count);
+        defer { free(&transient_memory.allocator, instances.data); };
+        
+        Draw_Instance_Group_Buffer instance_groups = ALLOCATE_ARRAY_INFO(&transient_memory.allocator, Draw_Instance_Group, 16);
+        defer { free(&transient_memory.allocator, instance_groups.data); };
+        
+        build_draw_instances(&instances, &instance_groups, draw_entities);
+        
+        clear_render_command_list(&render_commands);
+        record_draw_instances(&render_commands, Render_Program_Phong, Render_Material_Asteroid, instance_groups, make_vec4_scale(0.1f));
+        sort_render_commands(&render_commands);
+        
+        auto end = std::chrono::steady_clock::now();
+        f64 milliseconds = std::chrono::duration<f64, std::milli>(end - start).count();
+        
+        total_milliseconds += milliseconds;
+        max_milliseconds = MAX(max_milliseconds, milliseconds);
+        
+        record_frame_stats(&frame_stats, milliseconds, physics_milliseconds, physics_info.physics_step_count);
+        
+        printf("%u, %.3f, %u, %u, %u, %u, %u\n", frame, milliseconds, physics_info.physics_step_count, physics_info.pair_test_count, game.bodies.count, draw_entities.count, render_commands.commands.count);
+    }
+    
+    if (options.frame_count)
+        printf("average ms: %.3f max ms: %.3f\n", total_milliseconds / options.frame_count, max_milliseconds);
+    
+    {
+        const char *names[Frame_Stat_Count] = { "frame ms", "physics ms", "physics steps" };
+        
+        for (u32 stat = 0; stat < Frame_Stat_Count; ++stat) {
+            Frame_Stat_Percentiles percentiles = get_frame_stat_percentiles(&frame_stats, cast_v(Frame_Stat, stat));
+            printf("%s p50: %.3f p95: %.3f p99: %.3f max: %.3f\n", names[stat], percentiles.p50, percentiles.p95, percentiles.p99, percentiles.max);
+        }
+    }
+    
+    // fnv-1a over the simulated state of all bodies
+    {
+        u64 hash = 0xCBF29CE484222325ull;
+        
+        for (auto body = first(game.bodies); body != one_past_last(game.bodies); ++body) {
+            f32 values[6] = { body->sphere.center.x, body->sphere.center.y, body->sphere.center.z, body->velocity.x, body->velocity.y, body->velocity.z };
+            u8 *bytes = cast_p(u8, values);
+            
+            for (u32 i = 0; i < sizeof(values); ++i) {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ull;
+            }
+        }
+        
+        printf("body state hash: %016llx\n", cast_v(unsigned long long, hash));
+    }
+    
+    printf("physics scratch high-water bytes: %llu temporary: %llu\n", cast_v(unsigned long long, get_max_high_water_byte_count(&game.physics_arena)), cast_v(unsigned long long, get_max_high_water_byte_count(&game.physics_temporary_arena)));
+    
+    if (options.trace_path && !write_profile_trace(options.trace_path)) {
+        printf("could not write trace %s, is PROFILER_ENABLED defined?\n", options.trace_path);
+        return 1;
+    }
+    
+    return 0;
+}
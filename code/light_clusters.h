@@ -0,0 +1,233 @@
+#pragma once
+
+// clustered light assignment.
+// the view frustum is split into tiles in clip space and depth slices in view depth,
+// slices grow exponentially, so near clusters stay small. each light is assigned to all
+// clusters its sphere of influence (Light_Entity.radius) overlaps, the shaders fade lights
+// out towards their radius, so there is no seam at the cluster borders.
+// the shaders find their cluster from the fragment and only loop over its lights,
+// so the cost per fragment depends on the lights near it, not on all lights in the scene.
+// the output is compact: per cluster the first index and count into one light index list.
+// does not touch gl, the backend uploads the arrays as buffer textures.
+// needs game.h (Light_Entity).
+
+#define Light_Cluster_Tile_Count_X      16
+#define Light_Cluster_Tile_Count_Y      9
+#define Light_Cluster_Depth_Slice_Count 16
+#define Light_Cluster_Count (Light_Cluster_Tile_Count_X * Light_Cluster_Tile_Count_Y * Light_Cluster_Depth_Slice_Count)
+
+// view depths of the first and last slice, depths outside are clamped to them
+#define Light_Cluster_Near_Depth 1.0f
+#define Light_Cluster_Far_Depth  1000.0f
+
+// see get_light_radius, about 1 step of an 8 bit color
+#define Light_Cluster_Min_Attenuation (1.0f / 256.0f)
+
+// vec4f per light in light_data
+enum {
+    Light_Data_World_Position_And_Attenuation,
+    Light_Data_Diffuse_Color,
+    Light_Data_Specular_Color,
+    
+    // x is the radius
+    Light_Data_Radius,
+    
+    Light_Data_Stride,
+};
+
+struct Light_Clusters {
+    // Light_Data_Stride vec4f per light
+    vec4f *light_data;
+    u32 light_count;
+    
+    // 2 per cluster, first index into light_indices and count,
+    // cluster index is (slice * Light_Cluster_Tile_Count_Y + tile y) * Light_Cluster_Tile_Count_X + tile x
+    u32 *cluster_ranges;
+    
+    u32 *light_indices;
+    u32 light_index_count;
+    
+    // assignments that did not fit into max_light_index_count, should stay 0
+    u32 dropped_light_index_count;
+    
+    // slice = floor(log(view depth) * depth_slice_scale + depth_slice_bias)
+    f32 depth_slice_scale;
+    f32 depth_slice_bias;
+};
+
+// inclusive cluster coordinates
+struct Light_Cluster_Bounds {
+    u32 min[3];
+    u32 max[3];
+};
+
+// distance where 1 / (1 + attenuation * distance^2) reaches Light_Cluster_Min_Attenuation,
+// the radius of a light that is not cut off before it fades out on its own.
+// small attenuations reach far, only use it for the few lights that should light everything
+inline f32 get_light_radius(f32 attenuation)
+{
+    return sqrt((1.0f / Light_Cluster_Min_Attenuation - 1.0f) / MAX(attenuation, 0.000001f));
+}
+
+inline u32 get_light_cluster_slice(Light_Clusters *clusters, f32 depth)
+{
+    f32 slice = floor(log(MAX(depth, Light_Cluster_Near_Depth)) * clusters->depth_slice_scale + clusters->depth_slice_bias);
+    
+    return cast_v(u32, CLAMP(slice, 0.0f, cast_v(f32, Light_Cluster_Depth_Slice_Count - 1)));
+}
+
+inline u32 get_light_cluster_tile(f32 clip_coordinate, u32 tile_count)
+{
+    f32 tile = floor((clip_coordinate * 0.5f + 0.5f) * tile_count);
+    
+    return cast_v(u32, CLAMP(tile, 0.0f, cast_v(f32, tile_count - 1)));
+}
+
+// false if the light sphere misses the frustum.
+// camera looks along -z, the tiles are taken from the clip space bounds of the sphere's box,
+// which is conservative as long as the box is in front of the camera
+bool get_light_cluster_bounds(Light_Cluster_Bounds *bounds, Light_Clusters *clusters, vec3f camera_position, f32 radius, mat4f camera_to_clip_projection)
+{
+    f32 depth = -camera_position.z;
+    
+    if ((depth + radius < Light_Cluster_Near_Depth) || (depth - radius > Light_Cluster_Far_Depth))
+        return false;
+    
+    bounds->min[2] = get_light_cluster_slice(clusters, depth - radius);
+    bounds->max[2] = get_light_cluster_slice(clusters, depth + radius);
+    
+    // box reaches behind the near depth, projecting its corners would flip them
+    if (depth - radius < Light_Cluster_Near_Depth) {
+        bounds->min[0] = 0;
+        bounds->min[1] = 0;
+        bounds->max[0] = Light_Cluster_Tile_Count_X - 1;
+        bounds->max[1] = Light_Cluster_Tile_Count_Y - 1;
+        
+        return true;
+    }
+    
+    f32 clip_min[2] = {  1000000.0f,  1000000.0f };
+    f32 clip_max[2] = { -1000000.0f, -1000000.0f };
+    
+    for (u32 corner = 0; corner < 8; ++corner) {
+        vec3f position = camera_position;
+        position.x += (corner & 1) ? radius : -radius;
+        position.y += (corner & 2) ? radius : -radius;
+        position.z += (corner & 4) ? radius : -radius;
+        
+        vec4f clip = camera_to_clip_projection.columns[0] * position.x + camera_to_clip_projection.columns[1] * position.y + camera_to_clip_projection.columns[2] * position.z + camera_to_clip_projection.columns[3];
+        
+        f32 x = clip.x / clip.w;
+        f32 y = clip.y / clip.w;
+        
+        clip_min[0] = MIN(clip_min[0], x);
+        clip_min[1] = MIN(clip_min[1], y);
+        clip_max[0] = MAX(clip_max[0], x);
+        clip_max[1] = MAX(clip_max[1], y);
+    }
+    
+    if ((clip_max[0] < -1.0f) || (clip_min[0] > 1.0f) || (clip_max[1] < -1.0f) || (clip_min[1] > 1.0f))
+        return false;
+    
+    bounds->min[0] = get_light_cluster_tile(clip_min[0], Light_Cluster_Tile_Count_X);
+    bounds->min[1] = get_light_cluster_tile(clip_min[1], Light_Cluster_Tile_Count_Y);
+    bounds->max[0] = get_light_cluster_tile(clip_max[0], Light_Cluster_Tile_Count_X);
+    bounds->max[1] = get_light_cluster_tile(clip_max[1], Light_Cluster_Tile_Count_Y);
+    
+    return true;
+}
+
+void free_light_clusters(Light_Clusters *clusters, Memory_Allocator *allocator)
+{
+    // reverse order of allocation, works with stack allocators
+    free(allocator, clusters->light_indices);
+    free(allocator, clusters->cluster_ranges);
+    free(allocator, clusters->light_data);
+    
+    *clusters = {};
+}
+
+// fills clusters with new arrays from allocator, free them with free_light_clusters.
+// max_light_index_count is the size limit of the light index buffer texture
+void build_light_clusters(Light_Clusters *clusters, Light_Entity_Buffer lights, mat4x3f world_to_camera_transform, mat4f camera_to_clip_projection, u32 max_light_index_count, Memory_Allocator *allocator)
+{
+    PROFILE_SCOPE("build light clusters");
+    
+    *clusters = {};
+    clusters->depth_slice_scale = Light_Cluster_Depth_Slice_Count / log(Light_Cluster_Far_Depth / Light_Cluster_Near_Depth);
+    clusters->depth_slice_bias  = -log(Light_Cluster_Near_Depth) * clusters->depth_slice_scale;
+    
+    clusters->light_count = lights.count;
+    clusters->light_data = ALLOCATE_ARRAY(allocator, vec4f, MAX(lights.count, 1) * Light_Data_Stride);
+    
+    clusters->cluster_ranges = ALLOCATE_ARRAY(allocator, u32, Light_Cluster_Count * 2);
+    for (u32 i = 0; i < Light_Cluster_Count * 2; ++i)
+        clusters->cluster_ranges[i] = 0;
+    
+    // count lights per cluster
+    u32 total_count = 0;
+    for (u32 light_index = 0; light_index < lights.count; ++light_index) {
+        Light_Entity *light = lights.data + light_index;
+        
+        vec4f *data = clusters->light_data + light_index * Light_Data_Stride;
+        data[Light_Data_World_Position_And_Attenuation] = make_vec4(light->world_position, light->attenuation);
+        data[Light_Data_Diffuse_Color]  = light->diffuse_color;
+        data[Light_Data_Specular_Color] = light->specular_color;
+        data[Light_Data_Radius]         = vec4f{ light->radius, 0, 0, 0 };
+        
+        Light_Cluster_Bounds b;
+        if (!get_light_cluster_bounds(&b, clusters, transform_point(world_to_camera_transform, light->world_position), light->radius, camera_to_clip_projection))
+            continue;
+        
+        for (u32 z = b.min[2]; z <= b.max[2]; ++z) {
+            for (u32 y = b.min[1]; y <= b.max[1]; ++y) {
+                for (u32 x = b.min[0]; x <= b.max[0]; ++x)
+                    ++clusters->cluster_ranges[((z * Light_Cluster_Tile_Count_Y + y) * Light_Cluster_Tile_Count_X + x) * 2 + 1];
+            }
+        }
+        
+        total_count += (b.max[0] - b.min[0] + 1) * (b.max[1] - b.min[1] + 1) * (b.max[2] - b.min[2] + 1);
+    }
+    
+    // first indices, clusters past the limit lose their last lights
+    u32 offset = 0;
+    for (u32 cluster_index = 0; cluster_index < Light_Cluster_Count; ++cluster_index) {
+        u32 *range = clusters->cluster_ranges + cluster_index * 2;
+        range[0] = offset;
+        range[1] = MIN(range[1], max_light_index_count - offset);
+        offset += range[1];
+    }
+    
+    clusters->light_index_count = offset;
+    clusters->dropped_light_index_count = total_count - offset;
+    
+    clusters->light_indices = ALLOCATE_ARRAY(allocator, u32, MAX(offset, 1));
+    
+    // fill in light order, so each cluster lists its lights in the order of lights
+    u32 *fill_counts = ALLOCATE_ARRAY(allocator, u32, Light_Cluster_Count);
+    for (u32 i = 0; i < Light_Cluster_Count; ++i)
+        fill_counts[i] = 0;
+    
+    // bounds are computed again instead of kept, so only this temporary array is on top of the results
+    for (u32 light_index = 0; light_index < lights.count; ++light_index) {
+        Light_Entity *light = lights.data + light_index;
+        
+        Light_Cluster_Bounds b;
+        if (!get_light_cluster_bounds(&b, clusters, transform_point(world_to_camera_transform, light->world_position), light->radius, camera_to_clip_projection))
+            continue;
+        
+        for (u32 z = b.min[2]; z <= b.max[2]; ++z) {
+            for (u32 y = b.min[1]; y <= b.max[1]; ++y) {
+                for (u32 x = b.min[0]; x <= b.max[0]; ++x) {
+                    u32 cluster_index = (z * Light_Cluster_Tile_Count_Y + y) * Light_Cluster_Tile_Count_X + x;
+                    u32 *range = clusters->cluster_ranges + cluster_index * 2;
+                    
+                    if (fill_counts[cluster_index] < range[1])
+                        clusters->light_indices[range[0] + fill_counts[cluster_index]++] = light_index;
+                }
+            }
+        }
+    }
+    
+    free(allocator, fill_counts);
+}
@@ -6,137 +6,96 @@
 #include <tga.h>
 
 #include <stdlib.h>
+#include <chrono>
 
 #define Template_Geometry_Dimension_Count 3
 #include "geometry.h"
 
-struct Ship_Entity;
+#include "game.h"
+#include "render_commands.h"
+#include "uniform_ring_buffer.h"
+#include "light_clusters.h"
+#include "shader_cache.h"
+#include "replay.h"
+#include "frame_stats.h"
 
-enum Entity_Kind {
-    Ship_Kind = 0,
-    Asteroid_Kind,
-    Bullet_Kind,
-    Entity_Kind_Count,
-};
-
-struct Entity {
-    mat4x3f to_world_transform;
-    f32 orientation;
-    f32 scale;
-    f32 radius;
-    
-    vec3f velocity;
-    vec3f angular_rotation_axis;
-    f32   angular_velocity;
-    
-    vec4 diffuse_color;
-    vec4 specular_color;
-    bool is_light;
-    u32 kind;
-    Mesh *mesh;
-    Ship_Entity *ship;
-    Entity *parent;
-    bool mark_for_destruction;
-    
-    u32 hp;
-};
-
-struct Body {
-    Sphere3f sphere;
-    vec3f velocity;
-    //vec3f next_center;
-    //vec3f next_velocity;
-    
-    f32 velocity_accumulated_orientation;
-    u32 velocity_change_count;
-    
-    //f32 max_timestep;
-    u32 entity_index;
-    u32 first_clone_index;
-    bool destroy_on_collision;
-    bool was_destroyed;
+// all aliginged to vec4, since layout (std140) sux!!!
+struct Camera_Uniform_Block {
+    mat4f camera_to_clip_projection;
+    // actually a 4x3 but after each vec3 ther is 1 f32 padding
+    mat4f world_to_camera_transform;
+    vec3f camera_world_position;
+    f32 padding0;
 };
 
-#define Template_Array_Type      Body_Array
-#define Template_Array_Data_Type Body
-#include "template_array.h"
-
-struct Clone_Body {
-    Sphere3f sphere;
-    u32 body_index;
-    u32 offset_to_next_body;
+// the lights and their clusters are in buffer textures, see Light_Clusters
+struct Lighting_Uniform_Block {
+    u32 cluster_counts[3];
+    u32 light_count;
+    f32 depth_slice_scale;
+    f32 depth_slice_bias;
+    f32 padding[2];
 };
 
-#define Template_Array_Type      Clone_Body_Array
-#define Template_Array_Data_Type Clone_Body
-#include "template_array.h"
-
-struct Collision_Pair {
-    Body *body_pair[2];
-    Sphere3f spheres[2];
-    u32 collision_kind;
+enum {
+    Camera_Uniform_Block_Index = 0,
+    Lighting_Uniform_Block_Index,
 };
 
-#define Template_Array_Type      Collision_Pair_Array
-#define Template_Array_Data_Type Collision_Pair
-#include "template_array.h"
-
-struct Ship_Entity {
-    Entity *entity;
-    f32 thruster_intensity;
+// per instance attributes of the phong shader, see Draw_Instance.
+// they come after the vertex attributes of mesh.h, the transform takes one location per column
+enum {
+    Instance_Transform_Index = 8,
+    Instance_Diffuse_Color_Index = Instance_Transform_Index + 4,
+    Instance_Shininess_Index,
 };
 
-struct Draw_Entity {
-    mat4x3f to_world_transform;
-    Mesh *mesh;
-    vec4f color;
-    f32 shininess;
+// sampler units of the phong and water shaders, set once after loading
+enum {
+    Normal_Map_Texture_Unit = 0,
+    Diffuse_Texture_Unit,
+    
+    Texture_Unit_Count,
 };
 
-struct Light_Entity {
-    vec3f world_position;
-    vec4f diffuse_color;
-    vec4f specular_color;
-    f32   attenuation;
+// buffer textures of the light clusters, in order of their texture units after the shadowed ones.
+// bound once per frame before the render commands are submitted
+enum {
+    Light_Buffer_Data,
+    Light_Buffer_Clusters,
+    Light_Buffer_Indices,
+    
+    Light_Buffer_Count,
 };
 
-#define Template_Array_Type Entity_Buffer
-#define Template_Array_Data_Type Entity
-#define Template_Array_Is_Buffer
-#include "template_array.h"
+#define Light_Buffer_First_Texture_Unit Texture_Unit_Count
 
-#define Template_Array_Type      Draw_Entity_Buffer
-#define Template_Array_Data_Type Draw_Entity
-#define Template_Array_Is_Buffer
-#include "template_array.h"
+const GLenum Light_Buffer_Formats[Light_Buffer_Count] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
 
-#define Template_Array_Type      Light_Entity_Buffer
-#define Template_Array_Data_Type Light_Entity
-#define Template_Array_Is_Buffer
-#include "template_array.h"
+#define GL_State_Unknown 0xFFFFFFFF
 
-// all aliginged to vec4, since layout (std140) sux!!!
-struct Camera_Uniform_Block {
-    mat4f camera_to_clip_projection;
-    // actually a 4x3 but after each vec3 ther is 1 f32 padding
-    mat4f world_to_camera_transform;
-    vec3f camera_world_position;
-    f32 padding0;
+enum GL_State_Capability {
+    GL_State_Depth_Test,
+    GL_State_Blend,
+    
+    GL_State_Capability_Count,
 };
 
-#define MAX_LIGHT_COUNT 10
-
-struct Lighting_Uniform_Block {
-    vec4f diffuse_colors[MAX_LIGHT_COUNT];
-    vec4f specular_colors[MAX_LIGHT_COUNT];
-    vec4f world_positions_and_attenuations[MAX_LIGHT_COUNT];
-    u32 count;
-    u32 padding[3];
-};
+const GLenum GL_State_Capability_Enums[GL_State_Capability_Count] = { GL_DEPTH_TEST, GL_BLEND };
 
-enum {
-    Camera_Uniform_Block_Index = 0,
-    Lighting_Uniform_Block_Index,
+// the gl state last set through it, calls that would not change the state are skipped.
+// mooselib's immediate and ui rendering set state on their own, invalidate after them
+struct GL_State_Shadow {
+    GLuint program;
+    GLuint textures[Texture_Unit_Count];
+    u32 active_texture_unit;
+    
+    // 0, 1 or GL_State_Unknown
+    u32 capabilities[GL_State_Capability_Count];
+    
+    // per frame
+    u32 call_count;
+    u32 skipped_call_count;
 };
 
 struct Application_State {
@@ -186,17 +145,23 @@ struct Application_State {
     
     Mesh ship_mesh, asteroid_mesh, beam_mesh, planet_mesh;
     
-    union {
-        struct {
-            GLuint projection_uniform_buffer_object;
-            GLuint lighting_uniform_buffer_object;
-        };
-        
-        GLuint uniform_buffer_objects[2];
-    };
+    // camera and lighting blocks, rewritten every frame
+    Uniform_Ring_Buffer uniform_ring;
+    
+    // Draw_Instance per draw entity, refilled every frame
+    GLuint instance_buffer_object;
+    u32 instance_buffer_capacity;
+    
+    // Light_Clusters of the frame, orphaned and refilled every frame
+    GLuint light_buffer_objects[Light_Buffer_Count];
+    GLuint light_buffer_textures[Light_Buffer_Count];
+    u32 max_light_buffer_texel_count;
+    
+    Render_Command_List render_commands;
+    GL_State_Shadow gl_state;
     
     struct {
-        GLuint program_object;
+        Shader_Variant variant;
         
         union {
             
@@ -207,14 +172,17 @@ struct Application_State {
             u_ambient_color, \
             u_diffuse_texture, \
             u_diffuse_color, \
-            u_normal_map
+            u_normal_map, \
+            u_light_data, \
+            u_light_clusters, \
+            u_light_indices
             
             struct { GLint PHONG_UNIFORMS; };
             
             // sadly we cannot automate this,
-            // but make_shader_program will catch a missmatch
+            // but make_shader_program and get_shader_uniform_locations will catch a missmatch
             // while parsing the uniform_names string
-            GLint uniforms[7];
+            GLint uniforms[10];
         };
         
         GLuint camera_uniform_block;
@@ -223,7 +191,7 @@ struct Application_State {
     } phong_shader;
     
     struct {
-        GLuint program_object;
+        Shader_Variant variant;
         
         union {
             
@@ -235,14 +203,17 @@ struct Application_State {
             u_ambient_color, \
             u_diffuse_texture, \
             u_diffuse_color, \
-            u_normal_map
+            u_normal_map, \
+            u_light_data, \
+            u_light_clusters, \
+            u_light_indices
             
             struct { GLint WATER_SHADER_UNIFORMS; };
             
             // sadly we cannot automate this,
-            // but make_shader_program will catch a missmatch
+            // but make_shader_program and get_shader_uniform_locations will catch a missmatch
             // while parsing the uniform_names string
-            GLint uniforms[8];
+            GLint uniforms[11];
         };
         
         GLuint camera_uniform_block;
@@ -252,27 +223,67 @@ struct Application_State {
     
     Texture asteroid_normal_map;
     Texture asteroid_ambient_occlusion_map;
-    Entity_Buffer entities;
-    
-    Ship_Entity ship;
-    Entity *ship_thrusters;
+    Game_State game;
     Entity *beam;
     
     u8_array *debug_mesh_vertex_buffers;
     u32 debug_mesh_vertex_count;
     
-    bool in_debug_mode;
-    bool debug_use_game_controls;
-    bool pause_game;
+    Game_Area game_area;
+    
+    // asteroids are spawned over the game area, so the first game starts with the first frame
+    bool game_is_started;
+    
+    Replay_Recorder replay_recorder;
+    Replay_Player replay_player;
+    bool is_playing_replay;
+    
+    Frame_Stats frame_stats;
+    
+    // bit mask of Debug_Draw_Category
+    u32 debug_draw_categories;
 };
 
 Pixel_Dimensions const Reference_Resolution = { 1280, 720 };
 
+#define Start_Asteroid_Count 16
+
+// per frame, room for per draw blocks next to camera and lighting
+#define Uniform_Ring_Frame_Byte_Count KILO(64)
+
+// relative to the working directory
+#define Replay_File_Path "replay.bin"
+
+// written with T, only has zones if PROFILER_ENABLED is defined
+#define Profile_Trace_File_Path "trace.json"
+
+// written with C
+#define Frame_Stats_File_Path "frame_stats.csv"
+
+// linked shader programs, per Shader_Variant key
+#define Shader_Cache_File_Path_Format "shader_cache_%016llx.bin"
+
+// virtual key codes of Game_Key, in the same order
+u8 const Game_Key_Codes[Game_Key_Count] = {
+    'W', 'A', 'D', 'J',
+    'S', 'Q', 'E',
+    VK_F1, VK_F2, VK_F3,
+    VK_F5, VK_F6, VK_F7,
+    VK_F8, VK_F9, VK_F10, VK_F11, VK_F12,
+};
+
 f32 const Debug_Camera_Move_Speed = 50.0f;
 f32 const Debug_Camera_Mouse_Sensitivity = 2.0f * PIf / 2048.0f;
 vec3f const Debug_Camera_Axis_Alpha = VEC3_Z_AXIS;
 vec3f const Debug_Camera_Axis_Beta  = VEC3_X_AXIS;
 
+u64 get_random_seed() {
+    FILETIME system_time;
+    GetSystemTimeAsFileTime(&system_time);
+    
+    return (cast_v(u64, system_time.dwHighDateTime) << 32) | system_time.dwLowDateTime;
+}
+
 void debug_update_camera(Application_State *state) {
     quatf rotation = make_quat(Debug_Camera_Axis_Alpha, state->debug_camera_alpha);
     rotation = multiply(rotation, make_quat(Debug_Camera_Axis_Beta, state->debug_camera_beta));
@@ -298,80 +309,193 @@ void bind_ui_font_material(any new_material_pointer, any old_material_pointer) {
     glBindTexture(GL_TEXTURE_2D, new_material->texture->object);
 }
 
-void load_phong_shader(Application_State *state, Platform_API *platform_api)
+// draws the first command of the mesh batch instance_count times,
+// the instance attributes start at first_instance in the bound GL_ARRAY_BUFFER of Draw_Instance.
+// the attribute pointers are set per call, GL 3.3 has no base instance
+void draw_instances(Mesh *mesh, u32 first_instance, u32 instance_count)
 {
-    defer { assert(state->phong_shader.program_object); };
+    glBindVertexArray(mesh->batch.vertex_array_object);
     
-    string shader_source = platform_api->read_file(S("shaders/phong.shader.txt"), &state->transient_memory.allocator);
-    assert(shader_source.count);
+    u8 *instances = null;
+    instances += sizeof(Draw_Instance) * first_instance;
     
-    defer { free(&state->transient_memory.allocator, shader_source.data); };
+    for (u32 column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(Instance_Transform_Index + column);
+        glVertexAttribPointer(Instance_Transform_Index + column, 3, GL_FLOAT, GL_FALSE, sizeof(Draw_Instance), instances + offsetof(Draw_Instance, to_world_transform) + sizeof(vec3f) * column);
+        glVertexAttribDivisor(Instance_Transform_Index + column, 1);
+    }
     
-    Shader_Attribute_Info attributes[] = {
-        { Vertex_Position_Index, "a_position" },
-        { Vertex_Normal_Index,   "a_normal" },
-        { Vertex_Tangent_Index,  "a_tangent" },
-        { Vertex_UV_Index,       "a_uv" },
-    };
+    glEnableVertexAttribArray(Instance_Diffuse_Color_Index);
+    glVertexAttribPointer(Instance_Diffuse_Color_Index, 4, GL_FLOAT, GL_FALSE, sizeof(Draw_Instance), instances + offsetof(Draw_Instance, diffuse_color));
+    glVertexAttribDivisor(Instance_Diffuse_Color_Index, 1);
     
-    string uniform_names = S(STRINGIFY(PHONG_UNIFORMS));
-    
-    string global_defines = S(
-        "#version 150\n"
-        "#define MAX_LIGHT_COUNT 10\n"
-        "#define WITH_DIFFUSE_COLOR\n"
-        //"#define WITH_DIFFUSE_TEXTURE\n"
-        "#define WITH_NORMAL_MAP\n"
-        //"#define TANGENT_TRANSFORM_PER_FRAGMENT\n"
-        );
-    
-    string vertex_shader_sources[] = {
-        global_defines,
-        S("#define VERTEX_SHADER\n"),
-        shader_source,
-    };
+    glEnableVertexAttribArray(Instance_Shininess_Index);
+    glVertexAttribPointer(Instance_Shininess_Index, 1, GL_FLOAT, GL_FALSE, sizeof(Draw_Instance), instances + offsetof(Draw_Instance, shininess));
+    glVertexAttribDivisor(Instance_Shininess_Index, 1);
     
-    string fragment_shader_sources[] = {
-        global_defines,
-        S("#define FRAGMENT_SHADER\n"),
-        shader_source,
-    };
+    auto command = mesh->batch.commands;
+    glDrawElementsInstanced(mesh->batch.primitive_mode, command->count, mesh->batch.index_type, cast_p(void, cast_v(size_t, command->offset)), instance_count);
     
-    GLuint shader_objects[2];
-    shader_objects[0] = make_shader_object(GL_VERTEX_SHADER, ARRAY_WITH_COUNT(vertex_shader_sources), &state->transient_memory.allocator);
-    shader_objects[1] = make_shader_object(GL_FRAGMENT_SHADER, ARRAY_WITH_COUNT(fragment_shader_sources), &state->transient_memory.allocator);
+    glBindVertexArray(0);
+}
+
+void invalidate_gl_state(GL_State_Shadow *gl_state)
+{
+    gl_state->program = GL_State_Unknown;
+    gl_state->active_texture_unit = GL_State_Unknown;
     
-    if (!shader_objects[0] || !shader_objects[1])
+    for (u32 i = 0; i < Texture_Unit_Count; ++i)
+        gl_state->textures[i] = GL_State_Unknown;
+    
+    for (u32 i = 0; i < GL_State_Capability_Count; ++i)
+        gl_state->capabilities[i] = GL_State_Unknown;
+}
+
+void set_gl_program(GL_State_Shadow *gl_state, GLuint program)
+{
+    if (gl_state->program == program) {
+        ++gl_state->skipped_call_count;
         return;
+    }
     
-    GLint uniforms[ARRAY_COUNT(state->phong_shader.uniforms)];
+    glUseProgram(program);
+    gl_state->program = program;
+    ++gl_state->call_count;
+}
+
+void set_gl_texture(GL_State_Shadow *gl_state, u32 unit, GLuint texture)
+{
+    assert(unit < Texture_Unit_Count);
+    
+    if (gl_state->textures[unit] == texture) {
+        ++gl_state->skipped_call_count;
+        return;
+    }
     
-    GLuint program_object = make_shader_program(ARRAY_WITH_COUNT(shader_objects), true, ARRAY_WITH_COUNT(attributes), uniform_names, ARRAY_WITH_COUNT(uniforms), &state->transient_memory.allocator
-                                                );
+    if (gl_state->active_texture_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        gl_state->active_texture_unit = unit;
+        ++gl_state->call_count;
+    }
     
-    if (program_object) {
-        if (state->phong_shader.program_object) {
-            glUseProgram(0);
-            glDeleteProgram(state->phong_shader.program_object);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state->textures[unit] = texture;
+    ++gl_state->call_count;
+}
+
+void set_gl_capability(GL_State_Shadow *gl_state, u32 capability, bool enabled)
+{
+    if (gl_state->capabilities[capability] == cast_v(u32, enabled)) {
+        ++gl_state->skipped_call_count;
+        return;
+    }
+    
+    if (enabled)
+        glEnable(GL_State_Capability_Enums[capability]);
+    else
+        glDisable(GL_State_Capability_Enums[capability]);
+    
+    gl_state->capabilities[capability] = enabled;
+    ++gl_state->call_count;
+}
+
+// per draw uniforms a render program reads, -1 if it does not have them
+struct Render_Program_Info {
+    GLuint program_object;
+    GLint u_object_to_world_transform;
+    GLint u_ambient_color;
+    GLint u_diffuse_color;
+    GLint u_shininess;
+    GLint u_phase;
+};
+
+// sorts and draws the recorded commands, instances come from state->instance_buffer_object
+void submit_render_commands(Application_State *state, Render_Command_List *list, Immediate_Render_Context *imc)
+{
+    PROFILE_SCOPE("submit render commands");
+    
+    sort_render_commands(list);
+    
+    Render_Program_Info programs[Render_Program_Count] = {};
+    
+    programs[Render_Program_Phong].program_object              = state->phong_shader.variant.program_object;
+    programs[Render_Program_Phong].u_object_to_world_transform = state->phong_shader.u_object_to_world_transform;
+    programs[Render_Program_Phong].u_ambient_color             = state->phong_shader.u_ambient_color;
+    programs[Render_Program_Phong].u_diffuse_color             = state->phong_shader.u_diffuse_color;
+    programs[Render_Program_Phong].u_shininess                 = state->phong_shader.u_shininess;
+    programs[Render_Program_Phong].u_phase                     = -1;
+    
+    programs[Render_Program_Water].program_object              = state->water_shader.variant.program_object;
+    programs[Render_Program_Water].u_object_to_world_transform = state->water_shader.u_object_to_world_transform;
+    programs[Render_Program_Water].u_ambient_color             = state->water_shader.u_ambient_color;
+    programs[Render_Program_Water].u_diffuse_color             = state->water_shader.u_diffuse_color;
+    programs[Render_Program_Water].u_shininess                 = state->water_shader.u_shininess;
+    programs[Render_Program_Water].u_phase                     = state->water_shader.u_phase;
+    
+    GL_State_Shadow *gl_state = &state->gl_state;
+    
+    // the ui of the last frame changed the state
+    invalidate_gl_state(gl_state);
+    gl_state->call_count = 0;
+    gl_state->skipped_call_count = 0;
+    
+    glBindBuffer(GL_ARRAY_BUFFER, state->instance_buffer_object);
+    
+    u32 pass = Render_Pass_Count;
+    
+    for (auto command = first(list->commands); command != one_past_last(list->commands); ++command) {
+        if (command->pass != pass) {
+            pass = command->pass;
+            
+            set_gl_capability(gl_state, GL_State_Depth_Test, (pass == Render_Pass_Opaque));
+            set_gl_capability(gl_state, GL_State_Blend, (pass == Render_Pass_Transparent));
+            
+            if (pass == Render_Pass_Transparent)
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        
+        if (command->kind == Render_Command_Flush_Immediate) {
+            draw_and_flush(imc);
+            invalidate_gl_state(gl_state);
+            
+            // pass state has to be set again
+            pass = Render_Pass_Count;
+            continue;
         }
         
-        state->phong_shader.camera_uniform_block = glGetUniformBlockIndex(program_object, "Camera_Uniform_Block");
-        glUniformBlockBinding(program_object, state->phong_shader.camera_uniform_block, Camera_Uniform_Block_Index);
+        Render_Program_Info *program = programs + command->program;
+        set_gl_program(gl_state, program->program_object);
         
-        state->phong_shader.lighting_uniform_block = glGetUniformBlockIndex(program_object, "Lighting_Uniform_Block");
-        glUniformBlockBinding(program_object, state->phong_shader.lighting_uniform_block, Lighting_Uniform_Block_Index);
+        if (command->material == Render_Material_Asteroid) {
+            set_gl_texture(gl_state, Normal_Map_Texture_Unit, state->asteroid_normal_map.object);
+            set_gl_texture(gl_state, Diffuse_Texture_Unit, state->asteroid_ambient_occlusion_map.object);
+        }
         
+        glUniform4fv(program->u_ambient_color, 1, command->ambient_color);
         
-        state->phong_shader.program_object = program_object;
-        COPY(state->phong_shader.uniforms, uniforms, sizeof(uniforms));
+        if (command->kind == Render_Command_Draw_Instances) {
+            draw_instances(command->mesh, command->first_instance, command->instance_count);
+        }
+        else {
+            glUniformMatrix4x3fv(program->u_object_to_world_transform, 1, GL_FALSE, command->object_to_world_transform);
+            glUniform4fv(program->u_diffuse_color, 1, command->diffuse_color);
+            glUniform1f(program->u_shininess, command->shininess);
+            glUniform1f(program->u_phase, command->phase);
+            
+            draw(&command->mesh->batch, 0);
+        }
     }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void load_water_shader(Application_State *state, Platform_API *platform_api)
+void load_phong_shader(Application_State *state, Platform_API *platform_api)
 {
-    defer { assert(state->water_shader.program_object); };
+    PROFILE_SCOPE("load phong shader");
     
-    string shader_source = platform_api->read_file(S("shaders/water.shader.txt"), &state->transient_memory.allocator);
+    defer { assert(state->phong_shader.variant.program_object); };
+    
+    string shader_source = platform_api->read_file(S("shaders/phong.shader.txt"), &state->transient_memory.allocator);
     assert(shader_source.count);
     
     defer { free(&state->transient_memory.allocator, shader_source.data); };
@@ -381,130 +505,89 @@ void load_water_shader(Application_State *state, Platform_API *platform_api)
         { Vertex_Normal_Index,   "a_normal" },
         { Vertex_Tangent_Index,  "a_tangent" },
         { Vertex_UV_Index,       "a_uv" },
+        { Instance_Transform_Index,     "a_object_to_world_transform" },
+        { Instance_Diffuse_Color_Index, "a_instance_diffuse_color" },
+        { Instance_Shininess_Index,     "a_instance_shininess" },
     };
     
-    string uniform_names = S(STRINGIFY(WATER_SHADER_UNIFORMS));
-    
-    string global_defines = S(
-        "#version 150\n"
-        "#define MAX_LIGHT_COUNT 10\n"
-        "#define WITH_DIFFUSE_COLOR\n"
-        //"#define WITH_DIFFUSE_TEXTURE\n"
-        //"#define WITH_NORMAL_MAP\n"
-        //"#define TANGENT_TRANSFORM_PER_FRAGMENT\n"
-        );
-    
-    string vertex_shader_sources[] = {
-        global_defines,
-        S("#define VERTEX_SHADER\n"),
-        shader_source,
-    };
+    u32 options =
+        Shader_Option_Bit(Shader_Option_Diffuse_Color) |
+        //Shader_Option_Bit(Shader_Option_Diffuse_Texture) |
+        Shader_Option_Bit(Shader_Option_Normal_Map) |
+        //Shader_Option_Bit(Shader_Option_Tangent_Transform_Per_Fragment) |
+        Shader_Option_Bit(Shader_Option_Instancing) |
+        Shader_Option_Bit(Shader_Option_Light_Clusters);
     
-    string fragment_shader_sources[] = {
-        global_defines,
-        S("#define FRAGMENT_SHADER\n"),
-        shader_source,
-    };
-    
-    GLuint shader_objects[2];
-    shader_objects[0] = make_shader_object(GL_VERTEX_SHADER, ARRAY_WITH_COUNT(vertex_shader_sources), &state->transient_memory.allocator);
-    shader_objects[1] = make_shader_object(GL_FRAGMENT_SHADER, ARRAY_WITH_COUNT(fragment_shader_sources), &state->transient_memory.allocator);
+    GLint uniforms[ARRAY_COUNT(state->phong_shader.uniforms)];
     
-    if (!shader_objects[0] || !shader_objects[1])
+    // unchanged on hot reload or failed to compile
+    if (!load_shader_variant(&state->phong_shader.variant, shader_source, options, ARRAY_WITH_COUNT(attributes), S(STRINGIFY(PHONG_UNIFORMS)), ARRAY_WITH_COUNT(uniforms), Shader_Cache_File_Path_Format, &state->transient_memory.allocator))
         return;
     
-    GLint uniforms[ARRAY_COUNT(state->water_shader.uniforms)];
+    GLuint program_object = state->phong_shader.variant.program_object;
+    COPY(state->phong_shader.uniforms, uniforms, sizeof(uniforms));
     
-    GLuint program_object = make_shader_program(ARRAY_WITH_COUNT(shader_objects), true, ARRAY_WITH_COUNT(attributes), uniform_names, ARRAY_WITH_COUNT(uniforms), &state->transient_memory.allocator
-                                                );
+    state->phong_shader.camera_uniform_block = glGetUniformBlockIndex(program_object, "Camera_Uniform_Block");
+    glUniformBlockBinding(program_object, state->phong_shader.camera_uniform_block, Camera_Uniform_Block_Index);
     
-    if (program_object) {
-        if (state->water_shader.program_object) {
-            glUseProgram(0);
-            glDeleteProgram(state->water_shader.program_object);
-        }
-        
-        state->water_shader.camera_uniform_block = glGetUniformBlockIndex(program_object, "Camera_Uniform_Block");
-        glUniformBlockBinding(program_object, state->water_shader.camera_uniform_block, Camera_Uniform_Block_Index);
-        
-        state->water_shader.lighting_uniform_block = glGetUniformBlockIndex(program_object, "Lighting_Uniform_Block");
-        glUniformBlockBinding(program_object, state->water_shader.lighting_uniform_block, Lighting_Uniform_Block_Index);
-        
-        state->water_shader.program_object = program_object;
-        COPY(state->water_shader.uniforms, uniforms, sizeof(uniforms));
-    }
-}
-
-f32 random_f32(f32 min, f32 max) {
-    return (f32)rand() * (max - min) / RAND_MAX + min;
+    state->phong_shader.lighting_uniform_block = glGetUniformBlockIndex(program_object, "Lighting_Uniform_Block");
+    glUniformBlockBinding(program_object, state->phong_shader.lighting_uniform_block, Lighting_Uniform_Block_Index);
+    
+    // samplers keep their units, Render_Material_Asteroid binds the textures
+    glUseProgram(program_object);
+    glUniform1i(state->phong_shader.u_normal_map, Normal_Map_Texture_Unit);
+    glUniform1i(state->phong_shader.u_diffuse_texture, Diffuse_Texture_Unit);
+    glUniform1i(state->phong_shader.u_light_data,     Light_Buffer_First_Texture_Unit + Light_Buffer_Data);
+    glUniform1i(state->phong_shader.u_light_clusters, Light_Buffer_First_Texture_Unit + Light_Buffer_Clusters);
+    glUniform1i(state->phong_shader.u_light_indices,  Light_Buffer_First_Texture_Unit + Light_Buffer_Indices);
+    glUseProgram(0);
 }
 
-vec3f random_unit_vector(bool random_x = true, bool random_y = true, bool random_z = true) {
-    vec3f result;
+void load_water_shader(Application_State *state, Platform_API *platform_api)
+{
+    PROFILE_SCOPE("load water shader");
     
-    if (random_x)
-        result.x = random_f32(-1.0f, 1.0f);
-    else
-        result.x = 0.0f;
+    defer { assert(state->water_shader.variant.program_object); };
     
-    if (random_y)
-        result.y = random_f32(-1.0f, 1.0f);
-    else
-        result.y = 0.0f;
+    string shader_source = platform_api->read_file(S("shaders/water.shader.txt"), &state->transient_memory.allocator);
+    assert(shader_source.count);
     
-    if (random_z)
-        result.z = random_f32(-1.0f, 1.0f);
-    else
-        result.z = 0.0f;
+    defer { free(&state->transient_memory.allocator, shader_source.data); };
     
-    return normalize_or_zero(result);
-}
-
-u32 get_collision_kind(u32 entity_kind_a, u32 entity_kind_b) {
-    if (entity_kind_a < entity_kind_b)
-        return entity_kind_a * (Entity_Kind_Count - (entity_kind_a - 1) * 0.5f) + entity_kind_b - entity_kind_a;
-    else
-        return entity_kind_b * (Entity_Kind_Count - (entity_kind_b - 1) * 0.5f) + entity_kind_a - entity_kind_b;
-}
-
-u32 no_collision_kind() {
-    return get_collision_kind(Entity_Kind_Count, Entity_Kind_Count);
-}
-
-void spawn_asteroid(Application_State *state, vec3f position, vec3f velocity, f32 scale, vec4f color) {
-    Entity *asteroid = push(&state->entities, {});
-    asteroid->velocity = random_unit_vector(true, true, false) * random_f32(3.0f, 10.0f);
-    asteroid->diffuse_color = color;
-    asteroid->kind = Asteroid_Kind;
-    asteroid->mesh = &state->asteroid_mesh;
-    asteroid->scale = scale;
-    asteroid->radius = scale * 1.0f;
-    
-    asteroid->to_world_transform = MAT4X3_IDENTITY;
-    asteroid->to_world_transform.translation = position;
-    asteroid->angular_rotation_axis = random_unit_vector();
-    asteroid->angular_velocity = random_f32(0.0f, 2 * PIf);
-    
-    asteroid->hp = 32;
-}
-
-void spawn_bullet(Application_State *state) {
-    Entity *bullet = push(&state->entities, {});
-    
-    const f32 Bullet_Velocity = 30;
-    
-    bullet->velocity = state->ship.entity->to_world_transform.up * Bullet_Velocity;
-    bullet->diffuse_color = vec4f{ 0.2f, 0.2f, 1.0f, 1.0f };
-    bullet->kind = Bullet_Kind;
-    bullet->mesh = &state->beam_mesh;
-    bullet->scale = 1.0f;
-    bullet->radius = bullet->scale * 1.0f;
-    
-    bullet->to_world_transform = state->ship.entity->to_world_transform;
-    bullet->to_world_transform.translation += bullet->to_world_transform.up * (state->ship.entity->radius * 2);
-    bullet->orientation = state->ship.entity->orientation;
-    bullet->angular_rotation_axis = VEC3_Z_AXIS;
-    bullet->angular_velocity = 0;
+    Shader_Attribute_Info attributes[] = {
+        { Vertex_Position_Index, "a_position" },
+        { Vertex_Normal_Index,   "a_normal" },
+        { Vertex_Tangent_Index,  "a_tangent" },
+        { Vertex_UV_Index,       "a_uv" },
+    };
+    
+    u32 options =
+        Shader_Option_Bit(Shader_Option_Diffuse_Color) |
+        //Shader_Option_Bit(Shader_Option_Diffuse_Texture) |
+        //Shader_Option_Bit(Shader_Option_Normal_Map) |
+        //Shader_Option_Bit(Shader_Option_Tangent_Transform_Per_Fragment) |
+        Shader_Option_Bit(Shader_Option_Light_Clusters);
+    
+    GLint uniforms[ARRAY_COUNT(state->water_shader.uniforms)];
+    
+    // unchanged on hot reload or failed to compile
+    if (!load_shader_variant(&state->water_shader.variant, shader_source, options, ARRAY_WITH_COUNT(attributes), S(STRINGIFY(WATER_SHADER_UNIFORMS)), ARRAY_WITH_COUNT(uniforms), Shader_Cache_File_Path_Format, &state->transient_memory.allocator))
+        return;
+    
+    GLuint program_object = state->water_shader.variant.program_object;
+    COPY(state->water_shader.uniforms, uniforms, sizeof(uniforms));
+    
+    state->water_shader.camera_uniform_block = glGetUniformBlockIndex(program_object, "Camera_Uniform_Block");
+    glUniformBlockBinding(program_object, state->water_shader.camera_uniform_block, Camera_Uniform_Block_Index);
+    
+    state->water_shader.lighting_uniform_block = glGetUniformBlockIndex(program_object, "Lighting_Uniform_Block");
+    glUniformBlockBinding(program_object, state->water_shader.lighting_uniform_block, Lighting_Uniform_Block_Index);
+    
+    glUseProgram(program_object);
+    glUniform1i(state->water_shader.u_light_data,     Light_Buffer_First_Texture_Unit + Light_Buffer_Data);
+    glUniform1i(state->water_shader.u_light_clusters, Light_Buffer_First_Texture_Unit + Light_Buffer_Clusters);
+    glUniform1i(state->water_shader.u_light_indices,  Light_Buffer_First_Texture_Unit + Light_Buffer_Indices);
+    glUseProgram(0);
 }
 
 APP_INIT_DEC(application_init) {
@@ -519,6 +602,10 @@ APP_INIT_DEC(application_init) {
     state->persistent_memory = persistent_memory;
     state->transient_memory = make_growing_stack_allocator(&platform_api->allocator);
     
+    PROFILE_SCOPE("application init");
+    
+    state->debug_draw_categories = Debug_Draw_All_Categories;
+    
     init_gl();
     
     state->debug_camera_alpha = 0.0f;
@@ -532,6 +619,8 @@ APP_INIT_DEC(application_init) {
     init_immediate_render_context(&state->immediate_render_context, KILO(128), platform_api->read_file, &state->persistent_memory.allocator);
     
     {
+        PROFILE_SCOPE("load ui shader");
+        
         init_ui_render_context(&state->ui_render_context, KILO(10), 512, KILO(4), &state->persistent_memory.allocator);
         
         string vertex_shader_source = platform_api->read_file(S("shaders/textured_unprojected.vert.txt"), &state->persistent_memory.allocator);
@@ -577,77 +666,86 @@ APP_INIT_DEC(application_init) {
         state->ui_font_material.shader.program_object = program_object;
     }
     
-    glGenBuffers(2, state->uniform_buffer_objects);
-    glBindBuffer(GL_UNIFORM_BUFFER, state->projection_uniform_buffer_object);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(Camera_Uniform_Block), null, GL_STREAM_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, Camera_Uniform_Block_Index, state->projection_uniform_buffer_object);
+    init_uniform_ring_buffer(&state->uniform_ring, Uniform_Ring_Frame_Byte_Count);
     
-    glBindBuffer(GL_UNIFORM_BUFFER, state->lighting_uniform_buffer_object);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(Lighting_Uniform_Block), null, GL_STREAM_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, Lighting_Uniform_Block_Index, state->lighting_uniform_buffer_object);
+    glGenBuffers(1, &state->instance_buffer_object);
     
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    {
+        glGenBuffers(Light_Buffer_Count, state->light_buffer_objects);
+        glGenTextures(Light_Buffer_Count, state->light_buffer_textures);
+        
+        // the texture keeps referencing the buffer object when its storage is orphaned
+        for (u32 i = 0; i < Light_Buffer_Count; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, state->light_buffer_objects[i]);
+            glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4f), null, GL_STREAM_DRAW);
+            
+            glBindTexture(GL_TEXTURE_BUFFER, state->light_buffer_textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, Light_Buffer_Formats[i], state->light_buffer_objects[i]);
+        }
+        
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        
+        GLint max_texel_count;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texel_count);
+        state->max_light_buffer_texel_count = max_texel_count;
+    }
+    
+    init_render_command_list(&state->render_commands, &platform_api->allocator);
     
     load_phong_shader(state, platform_api);
     load_water_shader(state, platform_api);
     
-    state->font_lib = make_font_library();
-    state->font = make_font(state->font_lib, S("C:/Windows/Fonts/arial.ttf"), 10, ' ', 128, platform_api->read_file, &state->persistent_memory.allocator);
-    set_texture_filter_level(state->font.texture.object, Texture_Filter_Level_Linear);
+    {
+        PROFILE_SCOPE("load font");
+        
+        state->font_lib = make_font_library();
+        state->font = make_font(state->font_lib, S("C:/Windows/Fonts/arial.ttf"), 10, ' ', 128, platform_api->read_file, &state->persistent_memory.allocator);
+        set_texture_filter_level(state->font.texture.object, Texture_Filter_Level_Linear);
+    }
     
     state->ui_font_material.base.bind_material = bind_ui_font_material;
     state->ui_font_material.texture = &state->font.texture;
     
-    state->entities = ALLOCATE_ARRAY_INFO(&state->persistent_memory.allocator, Entity, 512);
-    
-    // make ship
+    state->game.ship_mesh     = &state->ship_mesh;
+    state->game.asteroid_mesh = &state->asteroid_mesh;
+    state->game.beam_mesh     = &state->beam_mesh;
     
     {
-        state->ship.entity = push(&state->entities, {});
+        PROFILE_SCOPE("load ship mesh");
         
         string source = platform_api->read_file(S("meshs/astroids_ship.glm"), &state->transient_memory.allocator);
         state->ship_mesh = make_mesh(source, &state->persistent_memory.allocator);
         free(&state->transient_memory.allocator, source.data);
-        
-        state->ship.entity->ship = &state->ship;
-        state->ship.entity->diffuse_color = make_vec4_scale(1.0f);
-        state->ship.entity->mesh = &state->ship_mesh;
-        state->ship.entity->scale  = 1.0f;
-        state->ship.entity->radius = state->ship.entity->scale * 1.0f;
-        state->ship.entity->angular_rotation_axis = VEC3_Z_AXIS;
-        state->ship.entity->angular_velocity = 0;
-        state->ship.entity->kind = Ship_Kind;
-        // will be updated anyway
-        state->ship.entity->to_world_transform = MAT4X3_IDENTITY;
-        
-        // thrusters
-        state->ship_thrusters = push(&state->entities, {});
-        state->ship_thrusters->is_light = true;
-        state->ship_thrusters->parent = state->ship.entity;
-        // make the radius big to have nicer lighting at border switch
-        state->ship_thrusters->radius = 10.0f;
-        state->ship_thrusters->scale = 1.0f;
-        state->ship_thrusters->to_world_transform = MAT4X3_IDENTITY;
-        state->ship_thrusters->to_world_transform.translation = vec3f{ 0.0f, -2.5f, 0.0f };
     }
     
-    bool debug_ok = tga_load_texture(&state->asteroid_normal_map, S("meshs/asteroid_normal_map.tga"), platform_api->read_file, &state->transient_memory.allocator);
-    debug_ok &= tga_load_texture(&state->asteroid_ambient_occlusion_map, S("meshs/asteroid_ambient_occlusion.tga"), platform_api->read_file, &state->transient_memory.allocator);
-    assert(debug_ok);
+    {
+        PROFILE_SCOPE("load textures");
+        
+        bool debug_ok = tga_load_texture(&state->asteroid_normal_map, S("meshs/asteroid_normal_map.tga"), platform_api->read_file, &state->transient_memory.allocator);
+        debug_ok &= tga_load_texture(&state->asteroid_ambient_occlusion_map, S("meshs/asteroid_ambient_occlusion.tga"), platform_api->read_file, &state->transient_memory.allocator);
+        assert(debug_ok);
+    }
     
     {
+        PROFILE_SCOPE("load asteroid mesh");
+        
         string source = platform_api->read_file(S("meshs/asteroid_baked.glm"), &state->transient_memory.allocator);
         state->asteroid_mesh = make_mesh(source, &state->persistent_memory.allocator, &state->debug_mesh_vertex_buffers, &state->debug_mesh_vertex_count);
         free(&state->transient_memory.allocator, source.data);
     }
     
     {
+        PROFILE_SCOPE("load planet mesh");
+        
         string source = platform_api->read_file(S("meshs/uv_sphere.glm"), &state->transient_memory.allocator);
         state->planet_mesh = make_mesh(source, &state->persistent_memory.allocator);
         free(&state->transient_memory.allocator, source.data);
     }
     
     {
+        PROFILE_SCOPE("load beam mesh");
+        
         string source = platform_api->read_file(S("meshs/asteroids_beam.glm"), &state->transient_memory.allocator);
         state->beam_mesh = make_mesh(source, &state->persistent_memory.allocator);
         free(&state->transient_memory.allocator, source.data);
@@ -656,12 +754,9 @@ APP_INIT_DEC(application_init) {
     state->camera.to_world_transform = make_transform(QUAT_IDENTITY, vec3f{ 0.0f, 0.0f, 80.0f });
     state->main_window_area = { -1, -1, cast_v(s16, 400 * width_over_height(Reference_Resolution)), 400 };
     
-    FILETIME system_time;
-    GetSystemTimeAsFileTime(&system_time);
-    srand(system_time.dwLowDateTime);
-    
-    for (u32 i = 0; i < 16; ++i)
-        spawn_asteroid(state, random_unit_vector(true, true, false) * random_f32(10.0f, 30.0f), vec3f{ 1.0f, 1.0f, 0.0f }, 3.0f, make_vec4(random_unit_vector() * 0.5f + vec3f{1.0f, 1.0f, 1.0f}));
+    // the platform allocator can free in any order, unlike the growing stacks
+    init_game(&state->game, &platform_api->allocator);
+    reset_game(&state->game, get_random_seed());
     
     return state;
 }
@@ -720,15 +815,13 @@ void output_sound(Sound_Buffer *sound_buffer, Immediate_Render_Context *imc) {
     }
 }
 
-vec3f mirror_offset(Plane3f plane) {
-    return plane.orthogonal * (-2 * plane.distance_to_origin / squared_length(plane.orthogonal));
-}
-
 APP_MAIN_LOOP_DEC(application_main_loop) {
     Application_State *state = CAST_P(Application_State, app_data_ptr);
     auto imc = &state->immediate_render_context;
     auto ui = &state->ui_render_context;
     
+    PROFILE_SCOPE("frame");
+    
     output_sound(output_sound_buffer, imc);
     
     {
@@ -759,36 +852,10 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
     
     clear(&state->transient_memory.memory_growing_stack);
     
-    // change game speed
-    static f32 game_speed = 1.0f;
-    static f32 backup_game_speed = 1.0f;
-    
-    if (was_pressed(input->keys[VK_F5])) {
-        game_speed = MAX(1.0f / 16.0f, game_speed * 0.5f);
-        backup_game_speed = 1.0f;
-    }
-    
-    if (was_pressed(input->keys[VK_F6])) {
-        game_speed = MIN(128, game_speed * 2.0f);
-        backup_game_speed = 1.0f;
-    }
-    
-    if (was_pressed(input->keys[VK_F7])) {
-        f32 temp = backup_game_speed;
-        backup_game_speed = game_speed;
-        game_speed = temp;
-    }
-    
-    delta_seconds *= game_speed;
-    
     // alt + F4 close application
     if (input->left_alt.is_active && was_pressed(input->keys[VK_F4]))
         PostQuitMessage(0);
     
-    // toggle game pause
-    if (was_pressed(input->keys[VK_F2]))
-        state->pause_game = !state->pause_game;
-    
     // toggle fullscreen, this may freez the app for about 5 seconds
     if (input->left_alt.is_active && was_pressed(input->keys[VK_RETURN]))
         state->main_window_is_fullscreen = !state->main_window_is_fullscreen;
@@ -814,20 +881,89 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
     ui_set_font(ui, &state->font, CAST_P(Render_Material, &state->ui_font_material));
     ui->font_rendering.color = rgba32{ 255, 255, 255, 255 };
     
-    if (was_pressed(input->keys[VK_F1]))
-        state->in_debug_mode = !state->in_debug_mode;
+    // wall clock time of the last frame, before replays and game speed change delta_seconds
+    f32 frame_seconds = delta_seconds;
+    
+    // game keys, from the keyboard or a replay
+    
+    Frame_Input frame_input = {};
+    frame_input.delta_seconds = delta_seconds;
+    
+    for (u32 key = 0; key < Game_Key_Count; ++key) {
+        if (input->keys[Game_Key_Codes[key]].is_active)
+            frame_input.active_keys |= 1 << key;
+        
+        if (was_pressed(input->keys[Game_Key_Codes[key]]))
+            frame_input.pressed_keys |= 1 << key;
+    }
+    
+    // R starts and stops recording, P starts and stops playback of the last recording,
+    // both restart the game
+    if (was_pressed(input->keys['R']) && !state->is_playing_replay && state->game_area.size.x) {
+        if (state->replay_recorder.file) {
+            stop_recording(&state->replay_recorder);
+        }
+        else {
+            u64 seed = get_random_seed();
+            
+            if (start_recording(&state->replay_recorder, Replay_File_Path, seed, Start_Asteroid_Count, state->game_area, state->game.options)) {
+                start_game(&state->game, seed, Start_Asteroid_Count, state->game_area);
+                state->game_is_started = true;
+            }
+        }
+    }
+    
+    if (was_pressed(input->keys['P']) && !state->replay_recorder.file) {
+        if (state->is_playing_replay) {
+            free_replay(&state->replay_player, &state->persistent_memory.allocator);
+            state->is_playing_replay = false;
+        }
+        else if (load_replay(&state->replay_player, Replay_File_Path, &state->persistent_memory.allocator)) {
+            state->is_playing_replay = true;
+            state->game.options = state->replay_player.header.options;
+            start_game(&state->game, state->replay_player.header.seed, state->replay_player.header.asteroid_count, state->replay_player.header.game_area);
+            state->game_is_started = true;
+        }
+    }
+    
+    if (state->is_playing_replay) {
+        if (!next_replay_frame(&state->replay_player, &frame_input)) {
+            free_replay(&state->replay_player, &state->persistent_memory.allocator);
+            state->is_playing_replay = false;
+        }
+    }
+    
+    if (state->replay_recorder.file)
+        record_frame(&state->replay_recorder, frame_input);
+    
+    // T writes all zones recorded since the last trace
+    if (was_pressed(input->keys['T']))
+        write_profile_trace(Profile_Trace_File_Path);
+    
+    delta_seconds = apply_option_keys(&state->game, frame_input);
+    
+    // debug draws only in debug mode, 1 to 6 toggle the Debug_Draw_Category in order
+    Debug_Draw debug_draw_context = { imc, state->debug_draw_categories };
+    Debug_Draw *debug_draw = null;
+    
+    if (state->game.options.in_debug_mode) {
+        for (u32 category = 0; category < Debug_Draw_Category_Count; ++category) {
+            if (was_pressed(input->keys['1' + category]))
+                state->debug_draw_categories ^= 1 << category;
+        }
+        
+        debug_draw_context.categories = state->debug_draw_categories;
+        debug_draw = &debug_draw_context;
+    }
     
     vec3f camera_world_position;
     vec3f imc_view_direction = {};
     
     // update debug camera
-    if (state->in_debug_mode) {
-        if (was_pressed(input->keys[VK_F3]))
-            state->debug_use_game_controls = !state->debug_use_game_controls;
+    if (state->game.options.in_debug_mode) {
+        f32 debug_delta_seconds = frame_input.delta_seconds;
         
-        f32 debug_delta_seconds = delta_seconds / game_speed;
-        
-        if (!state->debug_use_game_controls) {
+        if (!state->game.options.debug_use_game_controls) {
             if (was_pressed(input->mouse.right))
                 state->last_mouse_window_position = input->mouse.window_position;
             else if (input->mouse.right.is_active) {
@@ -845,22 +981,22 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
             
             vec3f direction = {};
             
-            if (input->keys['W'].is_active)
+            if (is_active(frame_input, Game_Key_Accelerate))
                 direction.z -= 1.0f;
             
-            if (input->keys['S'].is_active)
+            if (is_active(frame_input, Game_Key_Camera_Backward))
                 direction.z += 1.0f;
             
-            if (input->keys['A'].is_active)
+            if (is_active(frame_input, Game_Key_Rotate_Left))
                 direction.x -= 1.0f;
             
-            if (input->keys['D'].is_active)
+            if (is_active(frame_input, Game_Key_Rotate_Right))
                 direction.x += 1.0f;
             
-            if (input->keys['Q'].is_active)
+            if (is_active(frame_input, Game_Key_Camera_Down))
                 direction.y -= 1.0f;
             
-            if (input->keys['E'].is_active)
+            if (is_active(frame_input, Game_Key_Camera_Up))
                 direction.y += 1.0f;
             
             direction = normalize_or_zero(direction);
@@ -920,93 +1056,57 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
     
     vec3f area_size = top_right_corner - bottem_left_corner;
     
-    Plane3f area_planes[4];
-    
-    draw_circle(imc, bottem_left_corner, 2, VEC3_Z_AXIS, rgba32{255, 0, 0, 255});
-    draw_circle(imc, top_right_corner, 2, VEC3_Z_AXIS, rgba32{0, 255, 0, 255});
-    
-    vec3f a = bottem_left_corner;
-    vec3f b = a;
-    b.y += area_size.y;
-    area_planes[0] = make_plane(cross(b - a, VEC3_Z_AXIS), a);
-    draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[0].orthogonal) * 5, rgba32{0, 0, 255, 255});
+#if !defined(GAME_NO_DEBUG_DRAW)
+    if (is_debug_draw_enabled(debug_draw, Debug_Draw_Area_Planes)) {
+        Plane3f area_planes[4];
+        
+        draw_circle(imc, bottem_left_corner, 2, VEC3_Z_AXIS, rgba32{255, 0, 0, 255});
+        draw_circle(imc, top_right_corner, 2, VEC3_Z_AXIS, rgba32{0, 255, 0, 255});
+        
+        vec3f a = bottem_left_corner;
+        vec3f b = a;
+        b.y += area_size.y;
+        area_planes[0] = make_plane(cross(b - a, VEC3_Z_AXIS), a);
+        draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[0].orthogonal) * 5, rgba32{0, 0, 255, 255});
+        
+        a = b;
+        a.x += area_size.x;
+        area_planes[1] = make_plane(cross(a - b, VEC3_Z_AXIS), a);
+        draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[1].orthogonal) * 5, rgba32{0, 0, 255, 255});
+        
+        b = a;
+        b.y -= area_size.y;
+        area_planes[2] = make_plane(cross(b - a, VEC3_Z_AXIS), a);
+        draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[2].orthogonal) * 5, rgba32{0, 0, 255, 255});
+        
+        a = b;
+        a.x -= area_size.x;
+        area_planes[3] = make_plane(cross(a - b, VEC3_Z_AXIS), a);
+        draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[3].orthogonal) * 5, rgba32{0, 0, 255, 255});
+        
+        // draw game area
+        draw_rect(imc, bottem_left_corner, vec3{ area_size.x, 0.0f, 0.0f }, vec3{ 0.0f, area_size.y, 0.0f }, make_rgba32(1.0f, 1.0f, 0.0f));
+    }
+#endif
     
-    a = b;
-    a.x += area_size.x;
-    area_planes[1] = make_plane(cross(a - b, VEC3_Z_AXIS), a);
-    draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[1].orthogonal) * 5, rgba32{0, 0, 255, 255});
+    Game_Area game_area = { bottem_left_corner, area_size };
     
-    b = a;
-    b.y -= area_size.y;
-    area_planes[2] = make_plane(cross(b - a, VEC3_Z_AXIS), a);
-    draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[2].orthogonal) * 5, rgba32{0, 0, 255, 255});
+    // replays simulate in the recorded area
+    if (state->is_playing_replay)
+        game_area = state->replay_player.header.game_area;
     
-    a = b;
-    a.x -= area_size.x;
-    area_planes[3] = make_plane(cross(a - b, VEC3_Z_AXIS), a);
-    draw_line(imc, (a + b) * 0.5f, (a + b) * 0.5f + normalize(area_planes[3].orthogonal) * 5, rgba32{0, 0, 255, 255});
+    state->game_area = game_area;
     
-    // draw game area
-    draw_rect(imc, bottem_left_corner, vec3{ area_size.x, 0.0f, 0.0f }, vec3{ 0.0f, area_size.y, 0.0f }, make_rgba32(1.0f, 1.0f, 0.0f));
+    if (!state->game_is_started) {
+        start_game(&state->game, get_random_seed(), Start_Asteroid_Count, game_area);
+        state->game_is_started = true;
+    }
     
     
     // handle ship controls
     
-    Ship_Entity *ship = &state->ship;
-    
-    if (!state->pause_game) {
-        ship->thruster_intensity = MAX(0.0f, ship->thruster_intensity - delta_seconds);
-        
-        vec3f direction = {};
-        
-        f32 rotation = 0.0f;
-        f32 accelaration = 0.0f;
-        
-        const f32 Max_Velocity = 20.0f;
-        const f32 Acceleration = 25.0f;
-        const f32 Min_Acceleraton = Acceleration * 0.1f;
-        
-        if (!state->in_debug_mode || state->debug_use_game_controls) {
-            if (input->keys['W'].is_active) {
-                accelaration += Acceleration * delta_seconds;
-                ship->thruster_intensity = MAX(ship->thruster_intensity, 0.5f);
-            }
-            
-            if (was_pressed(input->keys['W'])) {
-                ship->thruster_intensity = 1.0f;
-                accelaration = MAX(Min_Acceleraton, accelaration);
-            }
-            
-            // rotate counter clockwise; mathematically positive
-            if (input->keys['A'].is_active)
-                rotation += 1.0f;
-            
-            // rotate clockwise; mathematically negative
-            if (input->keys['D'].is_active)
-                rotation -= 1.0f;
-            
-            const f32 Rotation_Speed = 2*PIf;
-            ship->entity->orientation += rotation * Rotation_Speed * delta_seconds;
-            
-            vec3f accelaration_vector = ship->entity->to_world_transform.up * accelaration;
-            
-            ship->entity->velocity += accelaration_vector;
-            f32 v2 = MIN(squared_length(ship->entity->velocity), Max_Velocity * Max_Velocity);
-            
-            ship->entity->velocity = normalize_or_zero(ship->entity->velocity) * sqrt(v2);
-            
-            if (was_pressed(input->keys['J'])) {
-                spawn_bullet(state);
-            }
-        }
-        
-        // turn thrusters on or off
-        state->ship_thrusters->is_light = (ship->thruster_intensity > 0);
-        if (state->ship_thrusters->is_light) {
-            state->ship_thrusters->diffuse_color  = vec4f{ 1, 1, 1, 1 } * ship->thruster_intensity;
-            state->ship_thrusters->specular_color = vec4f{ 1, 1, 0, 1 } * ship->thruster_intensity;
-        }
-    }
+    if (!state->game.options.pause_game)
+        set_ship_controls(&state->game, get_ship_controls(&state->game, frame_input));
     
 #if 0
     u32 position_stride;
@@ -1081,725 +1181,227 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
     // update physics and add draw, light entities
     
 #if 1
-    f32 max_timestep = delta_seconds;
-    
-    // Increase timestep in pause mode,
-    // to better visualize movement and collisions.
-    if (state->pause_game)
-        max_timestep = 2.0f;
+    Physics_Settings physics_settings = get_physics_settings(&state->game);
     
-    static u32 max_physics_step_count = 100;
+    auto physics_start = std::chrono::steady_clock::now();
     
-    if (was_pressed(input->keys[VK_F9]))
-        max_physics_step_count = 0;
+    // in pause mode only the next step is visualized
+    Physics_Step_Info physics_info = update_physics(&state->game, game_area, delta_seconds, state->game.options.pause_game, physics_settings, debug_draw);
     
-    if (max_physics_step_count && was_pressed(input->keys[VK_F10]))
-        --max_physics_step_count;
+    f32 physics_milliseconds = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - physics_start).count();
     
-    if (was_pressed(input->keys[VK_F11]))
-        ++max_physics_step_count;
+    u32 physics_step_count = physics_info.physics_step_count;
+    u32 pair_test_count    = physics_info.pair_test_count;
     
-    f32 margin = 0.2f;
+    record_frame_stats(&state->frame_stats, frame_seconds * 1000.0f, physics_milliseconds, physics_step_count);
     
-    Body_Array bodies = {};
-    defer { if (bodies.count) free(&state->transient_memory.allocator, bodies.data); };
+    // C writes the last Frame_Stats_Sample_Count frames
+    if (was_pressed(input->keys['C']))
+        write_frame_stats_csv(&state->frame_stats, Frame_Stats_File_Path);
     
-    for (auto entity = first(state->entities); entity != one_past_last(state->entities); ++entity) {
-        if (entity->parent)
-            continue;
-        
-        auto body = push(&bodies, null, 1, &state->transient_memory.allocator);
-        body->entity_index = index(state->entities, entity);
-        body->sphere = { entity->to_world_transform.translation, entity->radius };
-        body->velocity = entity->velocity;
-        
-        if (entity->kind == Bullet_Kind)
-            body->destroy_on_collision = true;
-        else
-            body->destroy_on_collision = false;
+    {
+        Frame_Stat_Percentiles frame = get_frame_stat_percentiles(&state->frame_stats, Frame_Stat_Frame_Milliseconds);
+        ui_printf(ui, 5, 90, S("frame ms p50: % p95: % p99: % max: %"), f(frame.p50), f(frame.p95), f(frame.p99), f(frame.max));
         
-        body->was_destroyed = false;
+        Frame_Stat_Percentiles physics = get_frame_stat_percentiles(&state->frame_stats, Frame_Stat_Physics_Milliseconds);
+        ui_printf(ui, 5, 120, S("physics ms p50: % p95: % p99: % max: %"), f(physics.p50), f(physics.p95), f(physics.p99), f(physics.max));
         
-        draw_circle(imc, entity->to_world_transform.translation, entity->radius, rgba32{ 255, 255, 0, 255 });
+        Frame_Stat_Percentiles steps = get_frame_stat_percentiles(&state->frame_stats, Frame_Stat_Physics_Step_Count);
+        ui_printf(ui, 5, 150, S("physics steps p50: % p95: % p99: % max: %"), f(steps.p50), f(steps.p95), f(steps.p99), f(steps.max));
     }
     
-    f32 debug_step_with   = 70.0f;
-    f32 debug_step_height = 2.0f;
-    f32 debug_step_x      = -debug_step_with * 0.5f;
-    f32 debug_step_y      = -10.0f;
-    vec3f debug_step_last_mark = vec3f{ debug_step_x, debug_step_y };
-    
-    draw_rect(imc, vec3f{ debug_step_x, debug_step_y - debug_step_height * 0.5f }, vec3f{ debug_step_with }, vec3f{ 0, debug_step_height }, rgba32{ 255, 255, 255, 255 });
-    
-    bool collision_table[RANGE_SUM(Entity_Kind_Count)] = {};
-    
-    collision_table[get_collision_kind(Asteroid_Kind, Asteroid_Kind)] = true;
-    collision_table[get_collision_kind(Ship_Kind    , Asteroid_Kind)] = true;
-    collision_table[get_collision_kind(Bullet_Kind  , Asteroid_Kind)] = true;
-    
-    bool reflection_table[RANGE_SUM(Entity_Kind_Count)] = {};
-    
-    reflection_table[get_collision_kind(Asteroid_Kind, Asteroid_Kind)] = true;
-    reflection_table[get_collision_kind(Ship_Kind    , Asteroid_Kind)] = true;
-    reflection_table[get_collision_kind(Ship_Kind    , Ship_Kind)]     = true;
-    
-    
-    f32 timestep = max_timestep;
-    u32 physics_step_count = 0;
-    while ((!max_physics_step_count || (physics_step_count < max_physics_step_count)) && (timestep > 0.00001f)) 
-    {
-        f32 min_allowed_timestep = timestep;
-        
-        Clone_Body_Array clones = {};
-        defer { if (clones.count) free(&state->transient_memory.allocator, clones.data); };
-        
-        for (auto body = first(bodies); body != one_past_last(bodies); ++body)
-        {
-            if (body->was_destroyed)
-                continue;
-            
-            u32 first_clone_index = clones.count;
-            body->first_clone_index = first_clone_index;
-            
-            auto first_clone = push(&clones, null, 1, &state->transient_memory.allocator);
-            first_clone->body_index          = index(bodies, body);
-            first_clone->sphere              = body->sphere;
-            first_clone->offset_to_next_body = 1;
-            
-            for (u32 plane_index = 0; plane_index < ARRAY_COUNT(area_planes); ++plane_index)
-            {
-                if (intersect(area_planes[plane_index], body->sphere))
-                {
-                    u32 clone_count = first_clone->offset_to_next_body;
-                    
-                    vec3f offset = mirror_offset(area_planes[plane_index]);
-                    
-                    for (u32 clone_index = first_clone_index; clone_index < first_clone_index + clone_count; ++clone_index)
-                    {
-                        auto clone = push(&clones, clones + clone_index, 1, &state->transient_memory.allocator);
-                        clone->sphere.center += offset;
-                        clone->offset_to_next_body = first_clone_index + clone_count - clone_index;
-                        
-                        draw_circle(imc, clone->sphere.center, clone->sphere.radius, make_rgba32(vec3f{ 1, 0, 1 } * ((timestep) / max_timestep)));
-                        
-                        clones[clone_index].offset_to_next_body += clone_count;
-                    }
-                }
-            }
-            
-#if 0            
-            body->next_velocity = body->velocity;
-            body->max_timestep  = timestep;
-            body->next_center   = body->sphere.center + body->velocity * body->max_timestep;
-#endif
-            
-        }
-        
-        Collision_Pair_Array collisions = {};
-        defer { if (collisions.count) free(&state->transient_memory.allocator, collisions.data); };
-        
-        Body *body_pair[2];
-        for (body_pair[0] = first(bodies); body_pair[0] != one_past_last(bodies); ++body_pair[0]) 
-        {
-            if (body_pair[0]->was_destroyed)
-                continue;
-            
-            Sphere3f moving_sphere = body_pair[0]->sphere;
-            
-            for (body_pair[1] = body_pair[0] + 1; body_pair[1] != one_past_last(bodies); ++body_pair[1]) {
-                if (body_pair[1]->was_destroyed)
-                    continue;
-                
-                u32 collision_kind = get_collision_kind(state->entities[body_pair[0]->entity_index].kind, state->entities[body_pair[1]->entity_index].kind);
-                
-                if (!collision_table[collision_kind])
-                    continue;
-                
-                vec3f movement = body_pair[0]->velocity - body_pair[1]->velocity;
-                
-                if (squared_length(movement) == 0.0f)
-                    continue;
-                
-                f32 movement_length = length(movement);
-                
-                f32 whole_timestep = 0.0f;
-                f32 remaining_timestep = timestep;
-                
-                while (true) {
-                    assert(remaining_timestep > 0.0f);
-                    
-                    vec3f next_moving_sphere_center;
-                    f32 moving_timestep = remaining_timestep;
-                    bool movement_was_split = false;
-                    
-                    for (u32 plane_index = 0; plane_index < ARRAY_COUNT(area_planes); ++plane_index) {
-                        f32 time_until_split = (area_planes[plane_index].distance_to_origin - dot(area_planes[plane_index].orthogonal, moving_sphere.center)) /
-                            dot(area_planes[plane_index].orthogonal, movement);
-                        
-                        if ((time_until_split == 0.0f) && (dot(area_planes[plane_index].orthogonal, movement) >= 0.0f))
-                            continue;
-                        
-                        if ((time_until_split >= 0.0f) && (time_until_split < moving_timestep)) {
-                            moving_timestep = time_until_split;
-                            next_moving_sphere_center = moving_sphere.center + movement * time_until_split + mirror_offset(area_planes[plane_index]);
-                            
-                            movement_was_split = true;
-                        }
-                    }
-                    
-                    if (moving_timestep == 0.0f) {
-                        moving_sphere.center = next_moving_sphere_center;
-                        continue;
-                    }
-                    
-                    f32 relative_margin = margin / (moving_timestep * movement_length);
-                    
-                    Clone_Body *first_static_clone = clones + body_pair[1]->first_clone_index;
-                    Clone_Body *one_past_last_static_clone = first_static_clone + first_static_clone->offset_to_next_body;
-                    for (auto static_clone = first_static_clone; static_clone != one_past_last_static_clone; ++static_clone)
-                    {
-                        Sphere3f static_sphere = static_clone->sphere;
-                        
-                        f32 t[2];
-                        u32 collision_count = movement_distance_until_collision(moving_sphere.center - static_sphere.center, movement * moving_timestep, moving_sphere.radius + static_sphere.radius, t);
-                        f32 d;
-                        switch (collision_count) {
-                            case 0:
-                            case 1: {
-                                d = 1.0f;
-                            } break;
-                            
-                            case 2: {
-                                if (t[0] >= 1.0f) {
-                                    d = MIN(1.0f, t[0] - relative_margin);
-                                    // d = 1.0f;
-                                    break;
-                                }
-                                
-                                if (t[0] > 0.0f) {
-                                    d = MAX(0.0f, t[0] - relative_margin);
-                                    break;
-                                }
-                                
-                                if (t[1] < 0.0f) {
-                                    d = 1.0f;
-                                    break;
-                                }
-                                
-                                // spheres are overlapping
-                                // find minimal time to pull them appart
-                                // either in past or in future
-                                if (-t[0] < t[1]) {
-                                    // rewind time until collision
-                                    //d = t[0] - relative_margin;
-                                    
-                                    // dont rewind, just ignore small overlaps and reflect
-                                    d = 0.0f;
-                                }
-                                else {
-                                    // sphere passed through, so we can also continue with full movement
-                                    //d = t[1] + relative_margin;
-                                    d = 1.0f;
-                                }
-                            } break;
-                            
-                            default:
-                            UNREACHABLE_CODE;
-                        }
-                        
-                        if (d < 1.0f) {
-                            f32 current_timestep = whole_timestep + moving_timestep * d;
-                            
-#if 0                                
-                            min_allowed_timestep = MIN(min_allowed_timestep, current_timestep);
-                            vec3f mirror_normal = normalize_or_zero(moving_sphere.center + body_pair[0]->velocity * (moving_timestep * d) - (static_sphere.center + body_pair[1]->velocity * current_timestep));
-#endif
-                            
-                            if (current_timestep < min_allowed_timestep) {
-                                min_allowed_timestep = current_timestep;
-                                if (collisions.count) {
-                                    free(&state->transient_memory.allocator, collisions.data);
-                                    collisions = {};
-                                }
-                            }
-                            
-                            if (current_timestep == min_allowed_timestep) {
-                                Collision_Pair pair;
-                                COPY(pair.body_pair, body_pair, sizeof(body_pair));
-                                pair.collision_kind = collision_kind;
-                                pair.spheres[0].center = moving_sphere.center + body_pair[0]->velocity * (moving_timestep * d);
-                                pair.spheres[0].radius = moving_sphere.radius;
-                                
-                                pair.spheres[1].center = static_sphere.center + body_pair[1]->velocity * current_timestep;
-                                pair.spheres[1].radius = static_sphere.radius;
-                                
-                                push(&collisions, pair, &state->transient_memory.allocator);
-                            }
-                            
-#if 0                                
-                            for (s32 pair_index = 0; pair_index < 2; ++pair_index) {
-                                auto body = body_pair[pair_index];
-                                
-                                if (body->max_timestep > current_timestep) {
-                                    body->max_timestep = current_timestep;
-                                    body->next_center  = body->sphere.center + body->velocity * current_timestep;
-                                    
-                                    if (body->destroy_on_collision)
-                                        body->was_destroyed = true;
-                                    
-                                    f32 damage_intensity =-dot(normalize_or_zero(body_pair[1 - pair_index]->sphere.center - body->sphere.center), normalize_or_zero(body_pair[1 - pair_index]->velocity));
-                                    
-                                    body->next_hp = body->hp - damage * MIN(1, cast_v(u32, damage_intensity * 4 + 0.5f));
-                                    
-                                    // reflect velocity
-                                    if (reflection_table[collision_kind] && (dot(mirror_normal * (pair_index * -2 + 1), body->velocity) <= 0))
-                                        body->next_velocity = body->velocity - mirror_normal * (2 * dot(mirror_normal, body->velocity));
-                                    else
-                                        body->next_velocity = body->velocity;
-                                }
-                            }
-#endif
-                            
-                            movement_was_split = false;
-                        }
-                    }
-                    
-                    if (!movement_was_split)
-                        break;
-                    
-                    whole_timestep     += moving_timestep;
-                    remaining_timestep -= moving_timestep;
-                    
-                    moving_sphere.center = next_moving_sphere_center;
-                }
-            }
-        }
-        
-        
-        rgba32 old_timestep_color = make_rgba32(vec3f{ 0, 0, 1 } * ((max_timestep - timestep) / max_timestep));
-        rgba32 new_timestep_color = make_rgba32(vec3f{ 0, 0, 1 } * ((max_timestep - timestep + min_allowed_timestep) / max_timestep));
-        
-        // draw relative timestep in scale
-        {
-            vec3f next_mark = debug_step_last_mark + vec3f{ min_allowed_timestep * debug_step_with / max_timestep };
-            
-            draw_line(imc, debug_step_last_mark, next_mark, old_timestep_color, true, new_timestep_color);
-            draw_line(imc, next_mark + vec3f{ 0, debug_step_height * 0.5f}, next_mark - vec3f{ 0, debug_step_height * 0.5f}, new_timestep_color);
-            
-            debug_step_last_mark = next_mark;
-        }
+#if !defined(GAME_NO_DEBUG_DRAW)
+    if (state->game.options.in_debug_mode) {
+        vec3f graph_size = vec3f{ game_area.size.x * 0.25f, 4.0f };
+        vec3f graph_corner = game_area.bottem_left_corner + vec3f{ 2.0f, 2.0f };
         
-        for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
-            
-            vec3f old_center = body->sphere.center;
-            
-            body->sphere.center = body->sphere.center + body->velocity * min_allowed_timestep;
-            
-            if (body->was_destroyed)
-                continue;
-            
-#if 0            
-            
-            u32 damage = (body->hp - body->next_hp) / 2;
-            body->hp = body->next_hp;
-            
-            if (damage) {
-                auto entity = state->entities + body->entity_index;
-                auto new_entity = push(&state->entities, state->entities[body->entity_index]);
-                
-                auto new_body = push(&bodies, *body, &state->transient_memory.allocator);
-                body->max_hp = damage;
-                body->hp = body->max_hp;
-                body->entity_index = index(state->entities, new_entity);
-                new_entity->scale = entity->scale * 0.5;
-                new_entity->radius = entity->radius * 0.5;
-                
-            }
-            
-            while (body->hp <= body->max_hp/2) {
-                body->max_hp /= 2;
-            }
-#endif
-            
-            f32 min_distance_to_border = min_allowed_timestep;
-            
-            bool was_outside_game_area;
-            do {
-                was_outside_game_area = false;
-                
-                f32 min_distance_to_border;
-                vec3f offset = vec3f{};
-                
-                // force body inside game area
-                for (u32 plane_index = 0; plane_index < ARRAY_COUNT(area_planes); ++plane_index)
-                {
-                    if (contains(area_planes[plane_index], body->sphere.center)) {
-                        f32 d = (area_planes[plane_index].distance_to_origin - dot(area_planes[plane_index].orthogonal, old_center)) /
-                            dot(area_planes[plane_index].orthogonal, body->velocity);
-                        
-                        if (!was_outside_game_area || (min_distance_to_border > d)) {
-                            min_distance_to_border = d;
-                            offset = mirror_offset(area_planes[plane_index]);
-                            was_outside_game_area = true;
-                        }
-                    }
-                }
-                
-                if (was_outside_game_area) {
-                    draw_line(imc, old_center, old_center + body->velocity * min_distance_to_border, old_timestep_color, true, new_timestep_color);
-                    
-                    body->sphere.center += offset;
-                    old_center = old_center + body->velocity * min_distance_to_border + offset;
-                }
-            } while (was_outside_game_area);
-            
-            draw_line(imc, old_center, body->sphere.center, old_timestep_color, true, new_timestep_color);
-            draw_circle(imc, body->sphere.center, body->sphere.radius, new_timestep_color);
-            
-            //body->velocity = body->next_velocity;
-            //body->next_velocity = body->velocity;
-            body->velocity_accumulated_orientation = 0.0f;
-            body->velocity_change_count = 0;
-        }
-        
-        for (auto collision = first(collisions); collision != one_past_last(collisions); ++collision) {
-            vec3f mirror_normal = normalize_or_zero(collision->spheres[0].center - collision->spheres[1].center);
-            
-            draw_line(imc, collision->spheres[0].center, collision->spheres[1].center, rgba32{ 255, 255, 0, 255 });
-            
-            u32 reflection_count = 0;
-            
-            for (s32 pair_index = 0; pair_index < 2; ++pair_index) {
-                auto body = collision->body_pair[pair_index];
-                
-                if (body->destroy_on_collision)
-                    body->was_destroyed = true;
-                
-#if 0                
-                f32 damage_intensity = -dot(normalize_or_zero(collision->body_pair[1 - pair_index]->sphere.center - body->sphere.center), normalize_or_zero(collision->body_pair[1 - pair_index]->velocity));
-                
-                body->next_hp = body->hp - damage * MIN(1, cast_v(u32, damage_intensity * 4 + 0.5f));
-#endif
-                
-                // reflect velocity
-                if (reflection_table[collision->collision_kind] && (dot(mirror_normal * (pair_index * -2 + 1), body->velocity) < 0)) {
-                    reflection_count++;
-                    //body->next_velocity = reflect(mirror_normal, body->velocity);
-                    
-                    vec3f normalized_velocity = normalize_or_zero(reflect(mirror_normal, body->velocity));
-                    
-                    f32 alpha = acos(dot(VEC3_Y_AXIS, normalized_velocity));
-                    f32 cos_beta = dot(VEC3_X_AXIS, normalized_velocity);
-                    
-                    if (cos_beta > 0)
-                        alpha *= -1;
-                    
-                    body->velocity_accumulated_orientation += alpha;
-                    body->velocity_change_count++;
-                }
-            }
-            
-            //assert(!reflection_table[collision->collision_kind] || reflection_count);
-            
-            if (reflection_table[collision->collision_kind] && !reflection_count) {
-                draw_circle(imc, collision->body_pair[0]->sphere.center, collision->body_pair[0]->sphere.radius, rgba32{ 255, 0, 0, 255 });
-                draw_circle(imc, collision->body_pair[1]->sphere.center, collision->body_pair[1]->sphere.radius, rgba32{ 255, 0, 0, 255 });
-                
-                timestep = 0.0f;
-            }
-        }
-        
-        for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
-            if (body->velocity_change_count) {
-                mat4x3f rotation = make_transform(make_quat(VEC3_Z_AXIS, body->velocity_accumulated_orientation / body->velocity_change_count));
-                
-                body->velocity = transform_direction(rotation, VEC3_Y_AXIS * length(body->velocity));
-            }
-        }
-        
-        ++physics_step_count;
-        timestep -= min_allowed_timestep;
+        rgba32 graph_colors[Frame_Stat_Count] = {
+            rgba32{ 255, 255, 255, 255 },
+            rgba32{ 0, 255, 255, 255 },
+            rgba32{ 255, 0, 255, 255 },
+        };
         
-        draw_and_flush(imc);
+        for (u32 stat = 0; stat < Frame_Stat_Count; ++stat)
+            draw_frame_stat_graph(imc, &state->frame_stats, cast_v(Frame_Stat, stat), graph_corner + vec3f{ 0, (graph_size.y + 1.0f) * (Frame_Stat_Count - 1 - stat) }, graph_size, graph_colors[stat]);
     }
+#endif
     
-    static u32 frame_count = 0;
-    frame_count++;
-    
-    static u32 physics_interation_count_accumalated = 0;
-    static f32 physics_interation_count_average = 0.0f;
-    
-    physics_interation_count_accumalated += physics_step_count;
-    static u32 physics_interation_max_count = 0;
-    physics_interation_max_count = MAX(physics_interation_max_count, physics_step_count);
+    if (physics_settings.use_brute_force_broadphase)
+        ui_printf(ui, 5, 180, S("pair tests (all pairs): %"), f(pair_test_count));
+    else
+        ui_printf(ui, 5, 180, S("pair tests (grid): %"), f(pair_test_count));
     
-    static f32 fps_accumalated = 0.0f;
-    static f32 fps_average = 0.0f;
-    fps_accumalated += game_speed / delta_seconds;
+    ui_printf(ui, 5, 210, S("narrowphase max workers: %"), f(physics_settings.narrowphase_worker_count));
     
-    const f32 trottle_timeout = 1.0f;
-    static f32 trottle_countdown = trottle_timeout;
-    trottle_countdown -= delta_seconds / game_speed;
+    if (state->replay_recorder.file)
+        ui_printf(ui, 5, 240, S("recording replay, frames: %"), f(state->replay_recorder.header.frame_count));
+    else if (state->is_playing_replay)
+        ui_printf(ui, 5, 240, S("playing replay, frame: % of %"), f(state->replay_player.frame_index), f(state->replay_player.header.frame_count));
     
-    if (trottle_countdown <= 0.0f) {
-        trottle_countdown += trottle_timeout;
-        
-        fps_average = fps_accumalated / frame_count;
-        physics_interation_count_average = physics_interation_count_accumalated / cast_v(f32, frame_count);
-        
-        frame_count = 0;
-        fps_accumalated = 0.0f;
-        physics_interation_count_accumalated = 0;
-    }
-    
-    ui_printf(ui, 5, 120, S("physics iteration count: % (%)"), f(physics_interation_count_average), f(physics_interation_max_count));
-    ui_printf(ui, 5, 90, S("fps: %"), f(fps_average));
+    // sizes the scratch memory for the worst levels
+    ui_printf(ui, 5, 270, S("physics scratch bytes: % + % (max: % + %)"), f(state->game.physics_arena.last_frame_high_water_byte_count), f(state->game.physics_temporary_arena.last_frame_high_water_byte_count), f(get_max_high_water_byte_count(&state->game.physics_arena)), f(get_max_high_water_byte_count(&state->game.physics_temporary_arena)));
     
-    if (!state->pause_game && (physics_step_count != max_physics_step_count)) {
-        
-        for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
-            state->entities[body->entity_index].to_world_transform.translation = body->sphere.center;
-            state->entities[body->entity_index].velocity                       = body->velocity;
-            
-            if (body->was_destroyed) {
-                state->entities[body->entity_index].mark_for_destruction = true;
-            }
-        }
-        
-        for (auto entity = first(state->entities); entity != one_past_last(state->entities); ++entity) {
-            if (entity->mark_for_destruction) {
-                unordered_remove(&state->entities, index(state->entities, entity));
-                --entity; // repeat current entity index
-            }
-        }
-    }
 #endif
     
-    Draw_Entity_Buffer  draw_entities  = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Draw_Entity, state->entities.count * 4);
+    Draw_Entity_Buffer  draw_entities  = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Draw_Entity, state->game.entities.count * 4);
     defer { free(&state->transient_memory.allocator, draw_entities.data); };
     
-    Light_Entity_Buffer light_entities = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Light_Entity, 10);
+    // one per draw entity at most, and the main light
+    Light_Entity_Buffer light_entities = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Light_Entity, state->game.entities.count * 4 + 1);
     defer { free(&state->transient_memory.allocator, light_entities.data); };
     
-    for (auto entity = first(state->entities); entity != one_past_last(state->entities); ++entity)
-    {
-        mat4x3f entity_to_world_transform;
-        
-        if (!entity->parent) {
-            if (!state->pause_game) {
-                //entity->to_world_transform.translation += entity->velocity * delta_seconds;
-                entity->orientation += entity->angular_velocity * delta_seconds;
-            }
-            
-            entity_to_world_transform = entity->to_world_transform;
-        }
-        else {
-            // make shure parents are processed befor children
-            // child address in buffer is higher then parent address
-            assert(entity > entity->parent);
-            entity_to_world_transform = entity->parent->to_world_transform * entity->to_world_transform;
-        }
-        
-        entity_to_world_transform = make_transform(make_quat(entity->angular_rotation_axis, entity->orientation), entity_to_world_transform.translation, make_vec3_scale(entity->scale));
-        
-        // only update top entities
-        if (!entity->parent)
-            entity->to_world_transform = entity_to_world_transform;
-        
-        s32 min_x;
-        s32 max_x;
-        if (entity_to_world_transform.translation.x - entity->radius < area_size.x * -0.5f) {
-            min_x = 0;
-            max_x = min_x + 2;
-        }
-        else if (entity_to_world_transform.translation.x + entity->radius > area_size.x * 0.5f) {
-            min_x = -1;
-            max_x = min_x + 2;
-        }
-        else {
-            min_x = 0;
-            max_x = 1;
-        }
-        
-        s32 min_y;
-        s32 max_y;
-        if ((entity_to_world_transform.translation.y - entity->radius < area_size.y * -0.5f)) {
-            min_y = 0;
-            max_y = min_y + 2;
-        }
-        else if ((entity_to_world_transform.translation.y + entity->radius > area_size.y * 0.5f)) {
-            min_y = -1;
-            max_y = min_y + 2;
-        }
-        else {
-            min_y = 0;
-            max_y = 1;
-        }
-        
-        for (s32 y = min_y; y < max_y; ++y) {
-            for (s32 x = min_x; x < max_x; ++x) {
-                mat4x3f transform = entity_to_world_transform;
-                
-                transform.translation.x += area_size.x * x;
-                transform.translation.y += area_size.y * y;
-                
-                if (entity->mesh) {
-                    Draw_Entity draw_entity;
-                    draw_entity.to_world_transform = transform;
-                    draw_entity.mesh = entity->mesh;
-                    draw_entity.color = entity->diffuse_color;
-                    draw_entity.shininess = 128.0f;
-                    push(&draw_entities, draw_entity);
-                }
-                
-                if (entity->is_light) {
-                    Light_Entity light_entity;
-                    light_entity.world_position = transform.translation;
-                    
-                    f32 intensity = 1.0f;
-                    
-                    if (light_entity.world_position.x < area_size.x * -0.5f)
-                        intensity *= 1.0f - (area_size.x * -0.5f - light_entity.world_position.x) / entity->radius;
-                    else if (light_entity.world_position.x > area_size.x * 0.5f)
-                        intensity *= 1.0f - (light_entity.world_position.x - area_size.x * 0.5f) / entity->radius;
-                    
-                    if (light_entity.world_position.y < area_size.y * -0.5f)
-                        intensity *= 1.0f - (area_size.y * -0.5f - light_entity.world_position.y) / entity->radius;
-                    else if (light_entity.world_position.y > area_size.y * 0.5f)
-                        intensity *= 1.0f - (light_entity.world_position.y - area_size.y * 0.5f) / entity->radius;
-                    
-                    if (state->in_debug_mode)
-                        draw_circle(imc, light_entity.world_position, entity->radius * intensity,  make_rgba32(x * 0.5f + 0.5f, 0, y * 0.5f + 0.5f)); // make_rgba32(entity->diffuse_color * intensity));
-                    
-                    light_entity.diffuse_color  = entity->diffuse_color  * intensity;
-                    light_entity.specular_color = entity->specular_color * intensity;
-                    light_entity.attenuation    = 0.005f;
-                    push(&light_entities, light_entity);
-                }
-            }
-        }
-    }
+    build_draw_lists(&draw_entities, &light_entities, &state->game, game_area, delta_seconds, state->game.options.pause_game, debug_draw);
     
     //ui_printf(ui, ui->anchors.left + 5, ui->anchors.top - 30, S("max physics iteration: %"), f(max_physics_step_count));
-    ui_printf(ui, ui->anchors.left + 5, ui->anchors.top - 60, S("game_speed: %"), f(game_speed));
+    ui_printf(ui, ui->anchors.left + 5, ui->anchors.top - 60, S("game_speed: %"), f(state->game.options.game_speed));
+    
+    if (state->game.options.in_debug_mode) {
+        u32 categories = state->debug_draw_categories;
+        ui_printf(ui, ui->anchors.left + 5, ui->anchors.top - 90, S("debug draw 1 bodies: % 2 clones: % 3 sweeps: % 4 collisions: % 5 area planes: % 6 lights: %"), f((categories >> Debug_Draw_Bodies) & 1), f((categories >> Debug_Draw_Clones) & 1), f((categories >> Debug_Draw_Sweeps) & 1), f((categories >> Debug_Draw_Collisions) & 1), f((categories >> Debug_Draw_Area_Planes) & 1), f((categories >> Debug_Draw_Lights) & 1));
+    }
     
     ui_printf(ui, 5, 30, S("light count: %"), f(light_entities.count));
     
     // rendering
     
+    // uniform blocks of this frame, unmapped before the render commands are submitted
+    begin_uniform_frame(&state->uniform_ring);
+    
     {
-        glBindBuffer(GL_UNIFORM_BUFFER, state->projection_uniform_buffer_object);
-        auto camera_block = cast_p(Camera_Uniform_Block, glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY));
+        PROFILE_SCOPE("camera uniform upload");
+        
+        Uniform_Allocation camera_uniforms = allocate_uniforms(&state->uniform_ring, sizeof(Camera_Uniform_Block));
+        bind_uniforms(&state->uniform_ring, Camera_Uniform_Block_Index, camera_uniforms);
+        
+        auto camera_block = cast_p(Camera_Uniform_Block, camera_uniforms.data);
         camera_block->camera_to_clip_projection = state->camera_to_clip_projection;
         
         for (u32 i = 0; i < 4; ++i)
             camera_block->world_to_camera_transform.columns[i] = make_vec4(state->world_to_camera_transform.columns[i], 0.0f);
         
         camera_block->camera_world_position = camera_world_position;
-        
-        glUnmapBuffer(GL_UNIFORM_BUFFER);
-    }
-    
-    glUseProgram(state->phong_shader.program_object);
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-    
-    u32 texture_index = 0;
-    
-    if (state->phong_shader.u_normal_map != -1) {
-        glUniform1i(state->phong_shader.u_normal_map, texture_index);
-        glActiveTexture(GL_TEXTURE0 + texture_index);
-        glBindTexture(GL_TEXTURE_2D, state->asteroid_normal_map.object);
-        
-        ++texture_index;
-    }
-    
-    if (state->phong_shader.u_diffuse_texture != -1) {
-        glUniform1i(state->phong_shader.u_diffuse_texture, texture_index);
-        glActiveTexture(GL_TEXTURE0 + texture_index);
-        glBindTexture(GL_TEXTURE_2D, state->asteroid_ambient_occlusion_map.object);
-        
-        ++texture_index;
     }
     
     // lights
     {
+        PROFILE_SCOPE("light cluster upload");
+        
         Light_Entity main_light;
         main_light.world_position = VEC3_Z_AXIS * 5; //  camera_world_position;
         //main_light.world_position = camera_world_position;
         main_light.diffuse_color  = vec4f{1, 1, 1, 1};
         main_light.specular_color = vec4f{1, 1, 1, 1};
         main_light.attenuation    = 0.005f;
+        // lights the whole area, but it is only one
+        main_light.radius         = get_light_radius(main_light.attenuation);
         push(&light_entities, main_light);
         
-        glBindBuffer(GL_UNIFORM_BUFFER, state->lighting_uniform_buffer_object);
-        auto lighting_block = cast_p(Lighting_Uniform_Block, glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY));
-        
-        u32 light_index = 0;
-        for (auto light_entity = first(light_entities); light_entity != one_past_last(light_entities); ++light_entity)
-        {
-            lighting_block->world_positions_and_attenuations[light_index] = make_vec4(light_entity->world_position, light_entity->attenuation);
-            
-            lighting_block->diffuse_colors[light_index] = light_entity->diffuse_color;
-            lighting_block->specular_colors[light_index] = light_entity->specular_color;
-            
-            if (state->in_debug_mode) {
+#if !defined(GAME_NO_DEBUG_DRAW)
+        if (is_debug_draw_enabled(debug_draw, Debug_Draw_Lights)) {
+            for (auto light_entity = first(light_entities); light_entity != one_past_last(light_entities); ++light_entity) {
                 draw_circle(imc, light_entity->world_position, squared_length(light_entity->diffuse_color), make_rgba32(light_entity->diffuse_color));
                 draw_circle(imc, light_entity->world_position, squared_length(light_entity->specular_color), make_rgba32(light_entity->specular_color));
             }
+        }
+#endif
+        
+        assert(light_entities.count * Light_Data_Stride <= state->max_light_buffer_texel_count);
+        
+        Light_Clusters clusters;
+        build_light_clusters(&clusters, light_entities, state->world_to_camera_transform, state->camera_to_clip_projection, state->max_light_buffer_texel_count, &state->transient_memory.allocator);
+        defer { free_light_clusters(&clusters, &state->transient_memory.allocator); };
+        
+        void *buffer_data[Light_Buffer_Count] = { clusters.light_data, clusters.cluster_ranges, clusters.light_indices };
+        
+        u32 buffer_byte_counts[Light_Buffer_Count] = {
+            cast_v(u32, sizeof(vec4f) * Light_Data_Stride * clusters.light_count),
+            cast_v(u32, sizeof(u32) * 2 * Light_Cluster_Count),
+            cast_v(u32, sizeof(u32) * clusters.light_index_count),
+        };
+        
+        // orphaned like the instance buffer, bound outside of the gl state shadow,
+        // submit_render_commands invalidates it anyway
+        for (u32 i = 0; i < Light_Buffer_Count; ++i) {
+            glBindBuffer(GL_TEXTURE_BUFFER, state->light_buffer_objects[i]);
+            glBufferData(GL_TEXTURE_BUFFER, MAX(buffer_byte_counts[i], cast_v(u32, sizeof(vec4f))), null, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, buffer_byte_counts[i], buffer_data[i]);
             
-            ++light_index;
+            glActiveTexture(GL_TEXTURE0 + Light_Buffer_First_Texture_Unit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, state->light_buffer_textures[i]);
         }
         
-        ui_printf(ui, 5, 60, S("uniform light count: %"), f(light_index));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
         
-        lighting_block->count = light_index;
+        Uniform_Allocation lighting_uniforms = allocate_uniforms(&state->uniform_ring, sizeof(Lighting_Uniform_Block));
+        bind_uniforms(&state->uniform_ring, Lighting_Uniform_Block_Index, lighting_uniforms);
         
-        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        auto lighting_block = cast_p(Lighting_Uniform_Block, lighting_uniforms.data);
+        lighting_block->cluster_counts[0] = Light_Cluster_Tile_Count_X;
+        lighting_block->cluster_counts[1] = Light_Cluster_Tile_Count_Y;
+        lighting_block->cluster_counts[2] = Light_Cluster_Depth_Slice_Count;
+        lighting_block->light_count       = clusters.light_count;
+        lighting_block->depth_slice_scale = clusters.depth_slice_scale;
+        lighting_block->depth_slice_bias  = clusters.depth_slice_bias;
+        
+        ui_printf(ui, 5, 60, S("clustered lights: % light indices: % dropped: %"), f(clusters.light_count), f(clusters.light_index_count), f(clusters.dropped_light_index_count));
     }
     
-    // render queue draw entities
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
+    // record render commands, submit_render_commands sorts them and sets the gl state
     
-    for (auto draw_entity = first(draw_entities); draw_entity != one_past_last(draw_entities); ++draw_entity)
-    {
-        glUniform4fv(state->phong_shader.u_ambient_color, 1, draw_entity->color * 0.1f);
-        glUniform4fv(state->phong_shader.u_diffuse_color, 1, draw_entity->color);
-        glUniformMatrix4x3fv(state->phong_shader.u_object_to_world_transform, 1, GL_FALSE, draw_entity->to_world_transform);
-        glUniform1f(state->phong_shader.u_shininess, draw_entity->shininess);
-        
-        draw(&draw_entity->mesh->batch, 0);
-    }
+    Render_Command_List *render_commands = &state->render_commands;
+    clear_render_command_list(render_commands);
     
     {
-        glDisable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        //glDisable(GL_CULL_FACE);
-        //defer { glEnable(GL_CULL_FACE); };
-        //glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        PROFILE_SCOPE("draw entities");
+        
+        Draw_Instance_Buffer instances = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Draw_Instance, draw_entities.count);
+        defer { free(&state->transient_memory.allocator, instances.data); };
+        
+        // one group per mesh
+        Draw_Instance_Group_Buffer instance_groups = ALLOCATE_ARRAY_INFO(&state->transient_memory.allocator, Draw_Instance_Group, 16);
+        defer { free(&state->transient_memory.allocator, instance_groups.data); };
+        
+        build_draw_instances(&instances, &instance_groups, draw_entities);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, state->instance_buffer_object);
+        
+        // orphan the last frame's storage, so we do not wait for draws that still read it
+        state->instance_buffer_capacity = MAX(state->instance_buffer_capacity, instances.count);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Draw_Instance) * state->instance_buffer_capacity, null, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Draw_Instance) * instances.count, instances.data);
         
-        glUseProgram(state->water_shader.program_object);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
         
-        glUniform4fv(state->water_shader.u_ambient_color, 1, vec4f{});
-        glUniform4fv(state->water_shader.u_diffuse_color, 1, vec4f{ 0.0f, 0.935f, 1.0f, 0.25f });
+        // multiplied with the instance diffuse color
+        record_draw_instances(render_commands, Render_Program_Phong, Render_Material_Asteroid, instance_groups, make_vec4_scale(0.1f));
         
+        ui_printf(ui, 5, 300, S("draw calls: % (draw entities: %)"), f(instance_groups.count), f(draw_entities.count));
+    }
+    
+    {
         static float phase = 0.0f;
         phase += delta_seconds;
         if (phase >= 1.0f)
             phase -= 1.0f;
         
-        glUniform1f(state->water_shader.u_phase, phase);
-        
         mat4x3f transform = make_transform(QUAT_IDENTITY, vec3f{ 5.0, 3.0f, 0.0f });
         
-        glUniformMatrix4x3fv(state->water_shader.u_object_to_world_transform, 1, GL_FALSE, transform);
-        glUniform1f(state->water_shader.u_shininess, 16.0f);
-        
-        draw(&state->planet_mesh.batch, 0);
+        record_draw_mesh(render_commands, Render_Pass_Transparent, Render_Program_Water, Render_Material_None, &state->planet_mesh, transform, vec4f{}, vec4f{ 0.0f, 0.935f, 1.0f, 0.25f }, 16.0f, phase, length(transform.translation - camera_world_position));
     }
     
+    // all world space debug draws of this frame in one go
+    record_flush_immediate(render_commands, Render_Pass_Overlay);
+    
+    unmap_uniform_frame(&state->uniform_ring);
+    
+    submit_render_commands(state, render_commands, imc);
+    
+    end_uniform_frame(&state->uniform_ring);
+    
+    ui_printf(ui, 5, 330, S("render commands: % gl state calls: % skipped: %"), f(render_commands->commands.count), f(state->gl_state.call_count), f(state->gl_state.skipped_call_count));
+    ui_printf(ui, 5, 360, S("uniform ring waits: %"), f(state->uniform_ring.wait_count));
+    
     if (input->keys[VK_TAB].is_active) 
     {
         //SCOPE_PUSH(imc->world_to_camera_transform, ui->transform);
@@ -1816,29 +1418,37 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
         bool f_button_active[12] = {};
         
         f_button_available[0] = true;
-        if (state->in_debug_mode) {
+        if (state->game.options.in_debug_mode) {
             f_button_active[0] = true;
             
             f_button_available[2] = true;
-            if (state->debug_use_game_controls)
+            if (state->game.options.debug_use_game_controls)
                 f_button_active[2] = true;
         }
         
         f_button_available[1] = true;
-        if (state->pause_game)
+        if (state->game.options.pause_game)
             f_button_active[1] = true;
         
         f_button_available[4] = true;
         f_button_available[5] = true;
         f_button_available[6] = true;
         
-        if (game_speed < 1.0f)
+        if (state->game.options.game_speed < 1.0f)
             f_button_active[4] = true;
-        else if (game_speed > 1.0f)
+        else if (state->game.options.game_speed > 1.0f)
             f_button_active[5] = true;
         else
             f_button_active[6] = true;
         
+        f_button_available[7] = true;
+        if (state->game.options.use_brute_force_broadphase)
+            f_button_active[7] = true;
+        
+        f_button_available[11] = true;
+        if (state->game.options.use_multithreaded_narrowphase)
+            f_button_active[11] = true;
+        
         SCOPE_PUSH(ui->font_rendering.alignment, vec2f{});
         SCOPE_PUSH(ui->font_rendering.color, {});
         
@@ -1865,11 +1475,16 @@ APP_MAIN_LOOP_DEC(application_main_loop) {
         }
     }
     
-    glDisable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
-    draw_and_flush(imc);
-    
-    glEnable(GL_BLEND);
-    //
-    draw(ui);
+    {
+        PROFILE_SCOPE("ui");
+        
+        // the button overlay
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        draw_and_flush(imc);
+        
+        glEnable(GL_BLEND);
+        //
+        draw(ui);
+    }
 }
\ No newline at end of file
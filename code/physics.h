@@ -0,0 +1,845 @@
+#pragma once
+
+// needs geometry.h with Template_Geometry_Dimension_Count 3,
+// template_array.h from mooselib, Entity_Kind and
+// a symmetric bool Collision_Matrix[Entity_Kind_Count][Entity_Kind_Count],
+// bodies of kinds that do not collide are never paired.
+// all memory of a physics step comes from scratch arenas, arena for memory
+// that lives until the end of the step (grid, collision events) and temporary_arena
+// for memory that is rewound after each resolved collision.
+
+#include <stdlib.h>
+
+#include "swept_sphere.h"
+#include "worker_threads.h"
+#include "scratch_arena.h"
+
+struct Body {
+    Sphere3f sphere;
+    vec3f velocity;
+    
+    // center at the start of the last simulation step, for render interpolation
+    vec3f previous_center;
+    
+    f32 velocity_accumulated_orientation;
+    u32 velocity_change_count;
+    
+    // slot of the entity, entities do not move while they are alive
+    u32 entity_index;
+    u32 kind;
+    bool destroy_on_collision;
+    bool was_destroyed;
+    
+    // bodies are moved lazily, sphere is at this time since the start of the frame
+    f32 time;
+    
+    // incremented on every velocity change or destruction,
+    // scheduled collisions with an older version are outdated
+    u32 version;
+    
+    // avoids visiting a body twice in one broadphase query
+    u32 visit_mark;
+};
+
+// bodies live in Game_State across frames and are
+// added and removed with their entities, kept packed for the simulation
+#define Template_Array_Type      Body_Buffer
+#define Template_Array_Data_Type Body
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+struct Collision_Pair {
+    Body *body_pair[2];
+    Sphere3f spheres[2];
+};
+
+#define Template_Array_Type      Collision_Pair_Array
+#define Template_Array_Data_Type Collision_Pair
+#include "template_array.h"
+
+// (first body index << 32) | second body index, first < second,
+// so sorting the keys gives the same pair order as the brute force loop
+#define Template_Array_Type      Body_Pair_Key_Array
+#define Template_Array_Data_Type u64
+#include "template_array.h"
+
+#define Template_Array_Type      Body_Index_Array
+#define Template_Array_Data_Type u32
+#include "template_array.h"
+
+// the game area wraps around in x and y,
+// leaving it on one side means entering it on the opposite side
+struct Game_Area {
+    vec3f bottem_left_corner;
+    vec3f size;
+};
+
+inline f32 wrap(f32 value, f32 min, f32 size) {
+    return value - size * floor((value - min) / size);
+}
+
+// same position inside the game area
+vec3f wrap_position(Game_Area area, vec3f position) {
+    position.x = wrap(position.x, area.bottem_left_corner.x, area.size.x);
+    position.y = wrap(position.y, area.bottem_left_corner.y, area.size.y);
+    
+    return position;
+}
+
+// shortest of all wrapped distances
+vec3f minimum_image_distance(Game_Area area, vec3f distance) {
+    distance.x -= area.size.x * floor(distance.x / area.size.x + 0.5f);
+    distance.y -= area.size.y * floor(distance.y / area.size.y + 0.5f);
+    
+    return distance;
+}
+
+// move body along its velocity, wrapping around the game area
+void move_body(Body *body, f32 delta_time, Game_Area area)
+{
+    body->time += delta_time;
+    
+    if (delta_time == 0.0f)
+        return;
+    
+    body->sphere.center = wrap_position(area, body->sphere.center + body->velocity * delta_time);
+}
+
+// center between the start (alpha 0) and the end (alpha 1) of the last simulation step
+vec3f get_interpolated_center(Body *body, f32 alpha, Game_Area area)
+{
+    vec3f distance = minimum_image_distance(area, body->sphere.center - body->previous_center);
+    
+    return wrap_position(area, body->previous_center + distance * alpha);
+}
+
+// center of body at a later time, without moving it
+vec3f get_body_center_at_time(Body *body, f32 time, Game_Area area)
+{
+    assert(time >= body->time);
+    
+    if (time == body->time)
+        return body->sphere.center;
+    
+    return wrap_position(area, body->sphere.center + body->velocity * (time - body->time));
+}
+
+void move_body_to_time(Body *body, f32 time, Game_Area area)
+{
+    body->sphere.center = get_body_center_at_time(body, time, area);
+    
+    // avoid drift from summing up deltas
+    body->time = time;
+}
+
+// start_center is the center of body_pair[1] at the start of timestep
+void set_collision_pair(Collision_Pair *collision, Body *body_pair[2], vec3f start_center, vec3f distance, vec3f sweep, f32 fraction, f32 timestep)
+{
+    f32 current_timestep = timestep * fraction;
+    
+    collision->body_pair[0] = body_pair[0];
+    collision->body_pair[1] = body_pair[1];
+    
+    collision->spheres[1].center = start_center + body_pair[1]->velocity * current_timestep;
+    collision->spheres[1].radius = body_pair[1]->sphere.radius;
+    
+    // body_pair[0] next to body_pair[1], maybe outside the game area
+    collision->spheres[0].center = collision->spheres[1].center + distance + sweep * fraction;
+    collision->spheres[0].radius = body_pair[0]->sphere.radius;
+}
+
+// narrowphase:
+// sweeps body_pair[0] relative to body_pair[1] over timestep.
+// instead of cloning bodies at the area borders we test against
+// all wrapped images of body_pair[1] close to the sweep,
+// usually only the minimum image.
+// start_centers are the centers of body_pair at the start of timestep,
+// so the bodies do not have to be moved there.
+// returns true and the earliest collision within timestep, if there is one.
+bool find_body_pair_collision(Collision_Pair *collision, f32 *collision_timestep, Body *body_pair[2], vec3f start_centers[2], Game_Area area, f32 timestep, f32 margin)
+{
+    assert(timestep > 0.0f);
+    
+    Sphere3f moving_sphere = { start_centers[0], body_pair[0]->sphere.radius };
+    Sphere3f static_sphere = { start_centers[1], body_pair[1]->sphere.radius };
+    
+    f32 fraction = get_swept_sphere_fraction(moving_sphere.center.x, moving_sphere.center.y, body_pair[0]->velocity.x, body_pair[0]->velocity.y, moving_sphere.radius, static_sphere.center.x, static_sphere.center.y, body_pair[1]->velocity.x, body_pair[1]->velocity.y, static_sphere.radius, area.size.x, area.size.y, timestep, margin);
+    
+    vec3f movement = body_pair[0]->velocity - body_pair[1]->velocity;
+    movement.z = 0.0f;
+    
+    vec3f sweep = movement * timestep;
+    
+    // relative to the nearest image of body_pair[1] at the start of the sweep
+    vec3f start = minimum_image_distance(area, moving_sphere.center - static_sphere.center);
+    start.z = 0.0f;
+    
+    if (fraction != Swept_Sphere_Needs_All_Images) {
+        if (fraction >= 1.0f)
+            return false;
+        
+        *collision_timestep = timestep * fraction;
+        set_collision_pair(collision, body_pair, static_sphere.center, start, sweep, fraction, timestep);
+        
+        return true;
+    }
+    
+    // the sweep is long or the area is small,
+    // test all images offset by image * area.size, that the sweep (plus margin) can touch
+    
+    f32 relative_margin = margin / (timestep * sqrt(movement.x * movement.x + movement.y * movement.y));
+    
+    f32 radius = moving_sphere.radius + static_sphere.radius;
+    f32 extent = radius + margin;
+    vec3f end = start + sweep;
+    
+    s32 min_image[2], max_image[2];
+    f32 min_position[2] = { MIN(start.x, end.x) - extent, MIN(start.y, end.y) - extent };
+    f32 max_position[2] = { MAX(start.x, end.x) + extent, MAX(start.y, end.y) + extent };
+    f32 area_size[2]    = { area.size.x, area.size.y };
+    
+    for (u32 axis = 0; axis < 2; ++axis) {
+        min_image[axis] = cast_v(s32, ceil(min_position[axis] / area_size[axis]));
+        max_image[axis] = cast_v(s32, floor(max_position[axis] / area_size[axis]));
+    }
+    
+    bool found_collision = false;
+    
+    for (s32 y = min_image[1]; y <= max_image[1]; ++y) {
+        for (s32 x = min_image[0]; x <= max_image[0]; ++x) {
+            vec3f distance = start - vec3f{ area.size.x * x, area.size.y * y, 0.0f };
+            
+            f32 d = get_swept_sphere_fraction(distance.x, distance.y, sweep.x, sweep.y, radius, relative_margin);
+            
+            if (d < 1.0f) {
+                f32 current_timestep = timestep * d;
+                
+                if (!found_collision || (current_timestep < *collision_timestep)) {
+                    found_collision = true;
+                    *collision_timestep = current_timestep;
+                    set_collision_pair(collision, body_pair, static_sphere.center, distance, sweep, d, timestep);
+                }
+            }
+        }
+    }
+    
+    return found_collision;
+}
+
+//
+// broadphase:
+// uniform grid over the game area, cell indices wrap around like the game area does.
+// each body is inserted into all cells overlapped by its sphere swept until the end of the frame
+// (plus margin), so every pair the narrowphase could report shares at least one cell.
+// bodies changing velocity are inserted again with their new sweep,
+// the old entries stay and only cost some extra narrowphase tests.
+//
+
+#define Broadphase_Max_Cell_Count_Per_Axis 256
+#define Broadphase_No_Entry 0xFFFFFFFF
+
+struct Broadphase_Cell_Entry {
+    u32 body_index;
+    u32 next_entry_index;
+};
+
+#define Template_Array_Type      Broadphase_Cell_Entry_Array
+#define Template_Array_Data_Type Broadphase_Cell_Entry
+#include "template_array.h"
+
+struct Broadphase_Grid {
+    vec2f origin;
+    vec2f cell_size;
+    s32 cell_counts[2];
+    
+    // linked list of entries per cell and body kind (cell * Entity_Kind_Count + kind),
+    // Broadphase_No_Entry if empty
+    u32 *first_entry_of_cell;
+    Broadphase_Cell_Entry_Array entries;
+};
+
+void get_broadphase_cell_range(Broadphase_Grid *grid, Body *body, f32 timestep, f32 margin, s32 min_cell[2], s32 max_cell[2])
+{
+    vec3f movement = body->velocity * timestep;
+    f32 extent = body->sphere.radius + margin;
+    
+    f32 min_position[2] = {
+        body->sphere.center.x - extent + MIN(0.0f, movement.x),
+        body->sphere.center.y - extent + MIN(0.0f, movement.y),
+    };
+    
+    f32 max_position[2] = {
+        body->sphere.center.x + extent + MAX(0.0f, movement.x),
+        body->sphere.center.y + extent + MAX(0.0f, movement.y),
+    };
+    
+    f32 origin[2]    = { grid->origin.x, grid->origin.y };
+    f32 cell_size[2] = { grid->cell_size.x, grid->cell_size.y };
+    
+    for (u32 axis = 0; axis < 2; ++axis) {
+        f32 min_cell_f = floor((min_position[axis] - origin[axis]) / cell_size[axis]);
+        f32 max_cell_f = floor((max_position[axis] - origin[axis]) / cell_size[axis]);
+        
+        // covers the whole axis, also avoids s32 overflow on huge sweeps
+        if (max_cell_f - min_cell_f + 1.0f >= grid->cell_counts[axis]) {
+            min_cell[axis] = 0;
+            max_cell[axis] = grid->cell_counts[axis] - 1;
+        }
+        else {
+            min_cell[axis] = cast_v(s32, min_cell_f);
+            max_cell[axis] = cast_v(s32, max_cell_f);
+        }
+    }
+}
+
+inline u32 wrap_cell(s32 cell, s32 cell_count) {
+    s32 result = cell % cell_count;
+    if (result < 0)
+        result += cell_count;
+    
+    return result;
+}
+
+inline u32 get_cell_index(Broadphase_Grid *grid, s32 x, s32 y) {
+    return wrap_cell(y, grid->cell_counts[1]) * grid->cell_counts[0] + wrap_cell(x, grid->cell_counts[0]);
+}
+
+// inserts the body swept over timestep
+void insert_body(Broadphase_Grid *grid, Body_Buffer bodies, Body *body, f32 timestep, f32 margin, Scratch_Arena *arena)
+{
+    s32 min_cell[2], max_cell[2];
+    get_broadphase_cell_range(grid, body, timestep, margin, min_cell, max_cell);
+    
+    for (s32 y = min_cell[1]; y <= max_cell[1]; ++y) {
+        for (s32 x = min_cell[0]; x <= max_cell[0]; ++x) {
+            u32 list = get_cell_index(grid, x, y) * Entity_Kind_Count + body->kind;
+            
+            Broadphase_Cell_Entry entry;
+            entry.body_index       = index(bodies, body);
+            entry.next_entry_index = grid->first_entry_of_cell[list];
+            
+            grid->first_entry_of_cell[list] = grid->entries.count;
+            push(&grid->entries, entry, arena);
+        }
+    }
+}
+
+// grid with all bodies swept over timestep
+Broadphase_Grid make_broadphase_grid(Body_Buffer bodies, Game_Area area, f32 timestep, f32 margin, Scratch_Arena *arena)
+{
+    Broadphase_Grid grid = {};
+    grid.origin = vec2f{ area.bottem_left_corner.x, area.bottem_left_corner.y };
+    
+    f32 max_radius = 0.0f;
+    for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
+        if (!body->was_destroyed)
+            max_radius = MAX(max_radius, body->sphere.radius);
+    }
+    
+    // bodies are mostly inserted in 1 - 4 cells if not moving too fast
+    f32 min_cell_size = 2.0f * (max_radius + margin);
+    
+    f32 area_extent[2] = { area.size.x, area.size.y };
+    f32 cell_size[2];
+    
+    for (u32 axis = 0; axis < 2; ++axis) {
+        s32 cell_count = cast_v(s32, area_extent[axis] / min_cell_size);
+        grid.cell_counts[axis] = CLAMP(cell_count, 1, Broadphase_Max_Cell_Count_Per_Axis);
+        cell_size[axis] = area_extent[axis] / grid.cell_counts[axis];
+    }
+    
+    grid.cell_size = vec2f{ cell_size[0], cell_size[1] };
+    
+    u32 list_count = grid.cell_counts[0] * grid.cell_counts[1] * Entity_Kind_Count;
+    grid.first_entry_of_cell = ALLOCATE_SCRATCH_ARRAY(arena, u32, list_count);
+    
+    for (u32 i = 0; i < list_count; ++i)
+        grid.first_entry_of_cell[i] = Broadphase_No_Entry;
+    
+    for (auto body = first(bodies); body != one_past_last(bodies); ++body) {
+        if (!body->was_destroyed)
+            insert_body(&grid, bodies, body, timestep, margin, arena);
+    }
+    
+    return grid;
+}
+
+int compare_body_pair_keys(const void *a, const void *b)
+{
+    u64 key_a = *cast_p(const u64, a);
+    u64 key_b = *cast_p(const u64, b);
+    
+    if (key_a < key_b)
+        return -1;
+    
+    return (key_a > key_b);
+}
+
+inline u64 make_body_pair_key(u32 body_index_a, u32 body_index_b) {
+    if (body_index_a > body_index_b) {
+        u32 temp = body_index_a;
+        body_index_a = body_index_b;
+        body_index_b = temp;
+    }
+    
+    return (cast_v(u64, body_index_a) << 32) | body_index_b;
+}
+
+inline u32 first_body_index(u64 key) {
+    return cast_v(u32, key >> 32);
+}
+
+inline u32 second_body_index(u64 key) {
+    return cast_v(u32, key);
+}
+
+// all candidate pairs sharing a cell, sorted and without duplicates.
+// only lists of kinds that collide are paired
+Body_Pair_Key_Array get_broadphase_pairs(Broadphase_Grid *grid, Scratch_Arena *arena)
+{
+    Body_Pair_Key_Array keys = {};
+    
+    u32 cell_count = grid->cell_counts[0] * grid->cell_counts[1];
+    for (u32 cell = 0; cell < cell_count; ++cell) {
+        u32 *first_entry_of_kind = grid->first_entry_of_cell + cell * Entity_Kind_Count;
+        
+        for (u32 kind_a = 0; kind_a < Entity_Kind_Count; ++kind_a) {
+            for (u32 kind_b = kind_a; kind_b < Entity_Kind_Count; ++kind_b) {
+                if (!Collision_Matrix[kind_a][kind_b])
+                    continue;
+                
+                for (u32 a = first_entry_of_kind[kind_a]; a != Broadphase_No_Entry; a = grid->entries[a].next_entry_index) {
+                    // same list: only entries after a
+                    u32 first_b = (kind_a == kind_b) ? grid->entries[a].next_entry_index : first_entry_of_kind[kind_b];
+                    
+                    for (u32 b = first_b; b != Broadphase_No_Entry; b = grid->entries[b].next_entry_index) {
+                        if (grid->entries[a].body_index != grid->entries[b].body_index)
+                            push(&keys, make_body_pair_key(grid->entries[a].body_index, grid->entries[b].body_index), arena);
+                    }
+                }
+            }
+        }
+    }
+    
+    if (!keys.count)
+        return keys;
+    
+    qsort(keys.data, keys.count, sizeof(u64), compare_body_pair_keys);
+    
+    u32 unique_count = 1;
+    for (u32 i = 1; i < keys.count; ++i) {
+        if (keys[i] != keys[unique_count - 1])
+            keys[unique_count++] = keys[i];
+    }
+    
+    keys.count = unique_count;
+    
+    return keys;
+}
+
+// appends all bodies sharing a cell with body swept over timestep,
+// that are of a kind body collides with.
+// visit_mark has to be unique per query
+void query_broadphase_candidates(Body_Index_Array *candidates, Broadphase_Grid *grid, Body_Buffer bodies, Body *body, f32 timestep, f32 margin, u32 visit_mark, Scratch_Arena *arena)
+{
+    s32 min_cell[2], max_cell[2];
+    get_broadphase_cell_range(grid, body, timestep, margin, min_cell, max_cell);
+    
+    body->visit_mark = visit_mark;
+    
+    for (s32 y = min_cell[1]; y <= max_cell[1]; ++y) {
+        for (s32 x = min_cell[0]; x <= max_cell[0]; ++x) {
+            u32 *first_entry_of_kind = grid->first_entry_of_cell + get_cell_index(grid, x, y) * Entity_Kind_Count;
+            
+            for (u32 kind = 0; kind < Entity_Kind_Count; ++kind) {
+                if (!Collision_Matrix[body->kind][kind])
+                    continue;
+                
+                for (u32 entry_index = first_entry_of_kind[kind]; entry_index != Broadphase_No_Entry; entry_index = grid->entries[entry_index].next_entry_index) {
+                    Body *other = bodies + grid->entries[entry_index].body_index;
+                    
+                    if (other->visit_mark == visit_mark)
+                        continue;
+                    
+                    other->visit_mark = visit_mark;
+                    push(candidates, index(bodies, other), arena);
+                }
+            }
+        }
+    }
+}
+
+//
+// collision scheduler:
+// a min heap of predicted collisions per pair, ordered by time and pair.
+// resolving a collision only reschedules the bodies that changed,
+// events of other pairs stay valid since their movement did not change.
+//
+
+struct Collision_Event {
+    // since the start of the frame
+    f32 time;
+    u32 body_versions[2];
+    Collision_Pair pair;
+};
+
+#define Template_Array_Type      Collision_Event_Array
+#define Template_Array_Data_Type Collision_Event
+#include "template_array.h"
+
+// ties are broken by pair, so simultaneous collisions
+// are resolved in the same order as the all pairs loop found them
+bool is_earlier(Collision_Event *a, Collision_Event *b, Body_Buffer bodies)
+{
+    if (a->time != b->time)
+        return (a->time < b->time);
+    
+    u64 key_a = make_body_pair_key(index(bodies, a->pair.body_pair[0]), index(bodies, a->pair.body_pair[1]));
+    u64 key_b = make_body_pair_key(index(bodies, b->pair.body_pair[0]), index(bodies, b->pair.body_pair[1]));
+    
+    return (key_a < key_b);
+}
+
+void push_collision_event(Collision_Event_Array *events, Collision_Event event, Body_Buffer bodies, Scratch_Arena *arena)
+{
+    push(events, event, arena);
+    
+    u32 child = events->count - 1;
+    while (child) {
+        u32 parent = (child - 1) / 2;
+        
+        if (!is_earlier(events->data + child, events->data + parent, bodies))
+            break;
+        
+        Collision_Event temp = events->data[parent];
+        events->data[parent] = events->data[child];
+        events->data[child]  = temp;
+        
+        child = parent;
+    }
+}
+
+Collision_Event pop_collision_event(Collision_Event_Array *events, Body_Buffer bodies)
+{
+    assert(events->count);
+    
+    Collision_Event result = events->data[0];
+    
+    --events->count;
+    events->data[0] = events->data[events->count];
+    
+    u32 parent = 0;
+    while (true) {
+        u32 earliest = parent;
+        u32 children[] = { parent * 2 + 1, parent * 2 + 2 };
+        
+        for (u32 i = 0; i < ARRAY_COUNT(children); ++i) {
+            if ((children[i] < events->count) && is_earlier(events->data + children[i], events->data + earliest, bodies))
+                earliest = children[i];
+        }
+        
+        if (earliest == parent)
+            break;
+        
+        Collision_Event temp = events->data[parent];
+        events->data[parent]   = events->data[earliest];
+        events->data[earliest] = temp;
+        
+        parent = earliest;
+    }
+    
+    return result;
+}
+
+bool is_outdated(Collision_Event *event)
+{
+    for (u32 i = 0; i < 2; ++i) {
+        Body *body = event->pair.body_pair[i];
+        
+        if (body->was_destroyed || (body->version != event->body_versions[i]))
+            return true;
+    }
+    
+    return false;
+}
+
+// scratch memory of find_body_collisions, large enough for capacity candidates
+struct Narrowphase_Scratch {
+    u32 *others;
+    f32 *fractions;
+    Swept_Sphere_Batch batch;
+};
+
+Narrowphase_Scratch make_narrowphase_scratch(u32 capacity, Scratch_Arena *arena)
+{
+    Narrowphase_Scratch scratch;
+    scratch.others           = ALLOCATE_SCRATCH_ARRAY(arena, u32, capacity);
+    scratch.fractions        = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.center_x   = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.center_y   = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.velocity_x = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.velocity_y = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.radius     = ALLOCATE_SCRATCH_ARRAY(arena, f32, capacity);
+    scratch.batch.count      = 0;
+    
+    return scratch;
+}
+
+bool is_narrowphase_candidate(Body *body, Body *other)
+{
+    return ((other != body) && !other->was_destroyed && Collision_Matrix[body->kind][other->kind]);
+}
+
+// finds collisions of body with all candidates and writes at most candidate_count events in candidate order.
+// candidates can be at an earlier time than body, they are extrapolated to it without being moved.
+// no body is changed, so the result does not depend on which other bodies were candidates before,
+// and this can run on worker threads as long as each has its own scratch and events.
+// candidates are tested in batches by the swept sphere kernel,
+// only candidates that can reach more than the nearest wrapped image use the scalar narrowphase.
+u32 find_body_collisions(Collision_Event *events, Narrowphase_Scratch *scratch, Body_Buffer bodies, Body *body, u32 *candidate_indices, u32 candidate_count, Game_Area area, f32 end_time, f32 margin, u32 *pair_test_count)
+{
+    if (body->was_destroyed || !candidate_count)
+        return 0;
+    
+    f32 time = body->time;
+    f32 timestep = end_time - time;
+    
+    if (timestep <= 0.00001f)
+        return 0;
+    
+    auto batch = &scratch->batch;
+    batch->count = 0;
+    
+    for (u32 i = 0; i < candidate_count; ++i) {
+        Body *other = bodies + candidate_indices[i];
+        
+        if (!is_narrowphase_candidate(body, other))
+            continue;
+        
+        vec3f other_center = get_body_center_at_time(other, time, area);
+        
+        scratch->others[batch->count]   = candidate_indices[i];
+        batch->center_x[batch->count]   = other_center.x;
+        batch->center_y[batch->count]   = other_center.y;
+        batch->velocity_x[batch->count] = other->velocity.x;
+        batch->velocity_y[batch->count] = other->velocity.y;
+        batch->radius[batch->count]     = other->sphere.radius;
+        ++batch->count;
+    }
+    
+    *pair_test_count += batch->count;
+    
+    get_swept_sphere_fractions(scratch->fractions, body->sphere, body->velocity, *batch, area.size, timestep, margin);
+    
+    u32 event_count = 0;
+    
+    for (u32 i = 0; i < batch->count; ++i) {
+        f32 fraction = scratch->fractions[i];
+        
+        if (fraction >= 1.0f)
+            continue;
+        
+        Body *other = bodies + scratch->others[i];
+        
+        // same value as in the batch
+        vec3f other_center = get_body_center_at_time(other, time, area);
+        
+        // lower index moves, like in the all pairs loop
+        Body *body_pair[2];
+        vec3f start_centers[2];
+        if (index(bodies, body) < scratch->others[i]) {
+            body_pair[0] = body;
+            body_pair[1] = other;
+            start_centers[0] = body->sphere.center;
+            start_centers[1] = other_center;
+        }
+        else {
+            body_pair[0] = other;
+            body_pair[1] = body;
+            start_centers[0] = other_center;
+            start_centers[1] = body->sphere.center;
+        }
+        
+        Collision_Event *event = events + event_count;
+        f32 collision_timestep;
+        
+        if (fraction == Swept_Sphere_Needs_All_Images) {
+            if (!find_body_pair_collision(&event->pair, &collision_timestep, body_pair, start_centers, area, timestep, margin))
+                continue;
+        }
+        else {
+            vec3f movement = body->velocity - other->velocity;
+            movement.z = 0.0f;
+            
+            vec3f distance = minimum_image_distance(area, body->sphere.center - other_center);
+            distance.z = 0.0f;
+            
+            // keep the distance from body_pair[1] to body_pair[0]
+            if (body_pair[0] != body) {
+                movement = -movement;
+                distance = -distance;
+            }
+            
+            collision_timestep = timestep * fraction;
+            set_collision_pair(&event->pair, body_pair, start_centers[1], distance, movement * timestep, fraction, timestep);
+        }
+        
+        event->time = time + collision_timestep;
+        event->body_versions[0] = body_pair[0]->version;
+        event->body_versions[1] = body_pair[1]->version;
+        ++event_count;
+    }
+    
+    return event_count;
+}
+
+// schedules collisions of body with all candidates.
+// candidates are not moved, only bodies of resolved collisions are,
+// so the brute force and grid broadphases leave the bodies bit identical
+void schedule_body_collisions(Collision_Event_Array *events, Body_Buffer bodies, Body *body, u32 *candidate_indices, u32 candidate_count, Game_Area area, f32 end_time, f32 margin, u32 *pair_test_count, Scratch_Arena *arena, Scratch_Arena *temporary_arena)
+{
+    if (body->was_destroyed || !candidate_count)
+        return;
+    
+    Narrowphase_Scratch scratch = make_narrowphase_scratch(candidate_count, temporary_arena);
+    Collision_Event *found_events = ALLOCATE_SCRATCH_ARRAY(temporary_arena, Collision_Event, candidate_count);
+    
+    u32 found_event_count = find_body_collisions(found_events, &scratch, bodies, body, candidate_indices, candidate_count, area, end_time, margin, pair_test_count);
+    
+    for (u32 i = 0; i < found_event_count; ++i)
+        push_collision_event(events, found_events[i], bodies, arena);
+}
+
+//
+// parallel narrowphase:
+// jobs are split into contiguous ranges, one per worker.
+// each worker writes its events into its own buffer and the buffers are pushed
+// in job order, so the events are pushed in the same order for any worker count
+// and the simulation stays bit identical to a single threaded run.
+//
+
+// the pair tests of one body against its candidates
+struct Body_Collision_Job {
+    u32 body_index;
+    u32 candidate_count;
+    u32 *candidate_indices;
+};
+
+#define Template_Array_Type      Body_Collision_Job_Array
+#define Template_Array_Data_Type Body_Collision_Job
+#include "template_array.h"
+
+// below this many candidates per worker, starting threads costs more than it saves
+#define Narrowphase_Min_Candidates_Per_Worker 2048
+
+struct Narrowphase_Worker {
+    Body_Collision_Job *jobs;
+    u32 job_count;
+    
+    Narrowphase_Scratch scratch;
+    Collision_Event *events;
+    u32 event_count;
+    u32 pair_test_count;
+};
+
+struct Narrowphase_Work {
+    Narrowphase_Worker *workers;
+    Body_Buffer bodies;
+    Game_Area area;
+    f32 end_time;
+    f32 margin;
+};
+
+void run_narrowphase_worker(void *data, u32 worker_index)
+{
+    PROFILE_SCOPE("narrowphase worker");
+    
+    auto work = cast_p(Narrowphase_Work, data);
+    auto worker = work->workers + worker_index;
+    
+    for (auto job = worker->jobs; job != worker->jobs + worker->job_count; ++job) {
+        worker->event_count += find_body_collisions(worker->events + worker->event_count, &worker->scratch, work->bodies, work->bodies + job->body_index, job->candidate_indices, job->candidate_count, work->area, work->end_time, work->margin, &worker->pair_test_count);
+    }
+}
+
+// schedules all jobs on up to max_worker_count threads,
+// all bodies need to be at the same time, so the workers only read them.
+void schedule_body_collisions_parallel(Collision_Event_Array *events, Body_Buffer bodies, Body_Collision_Job_Array jobs, u32 max_worker_count, Game_Area area, f32 end_time, f32 margin, u32 *pair_test_count, Scratch_Arena *arena, Scratch_Arena *temporary_arena)
+{
+    if (!jobs.count)
+        return;
+    
+    PROFILE_SCOPE("narrowphase");
+    
+    u32 total_candidate_count = 0;
+    for (auto job = first(jobs); job != one_past_last(jobs); ++job)
+        total_candidate_count += job->candidate_count;
+    
+    u32 worker_count = MIN(max_worker_count, total_candidate_count / Narrowphase_Min_Candidates_Per_Worker);
+    worker_count = CLAMP(worker_count, 1, jobs.count);
+    
+    Narrowphase_Worker *workers = ALLOCATE_SCRATCH_ARRAY(temporary_arena, Narrowphase_Worker, worker_count);
+    
+    // split jobs by candidate count, so all workers do about the same amount of pair tests
+    {
+        u32 job_index = 0;
+        u32 assigned_candidate_count = 0;
+        
+        for (u32 worker_index = 0; worker_index < worker_count; ++worker_index) {
+            auto worker = workers + worker_index;
+            *worker = {};
+            worker->jobs = jobs.data + job_index;
+            
+            u32 worker_end = (u32)((u64)total_candidate_count * (worker_index + 1) / worker_count);
+            u32 max_candidate_count = 0;
+            u32 worker_candidate_count = 0;
+            
+            while ((job_index < jobs.count) && ((assigned_candidate_count < worker_end) || (worker_index == worker_count - 1))) {
+                max_candidate_count = MAX(max_candidate_count, jobs[job_index].candidate_count);
+                worker_candidate_count += jobs[job_index].candidate_count;
+                assigned_candidate_count += jobs[job_index].candidate_count;
+                ++worker->job_count;
+                ++job_index;
+            }
+            
+            // each candidate gives at most one event
+            if (worker_candidate_count) {
+                worker->scratch = make_narrowphase_scratch(max_candidate_count, temporary_arena);
+                worker->events  = ALLOCATE_SCRATCH_ARRAY(temporary_arena, Collision_Event, worker_candidate_count);
+            }
+            else {
+                worker->job_count = 0;
+            }
+        }
+    }
+    
+    Narrowphase_Work work;
+    work.workers         = workers;
+    work.bodies          = bodies;
+    work.area            = area;
+    work.end_time        = end_time;
+    work.margin          = margin;
+    
+    run_workers(worker_count, run_narrowphase_worker, &work);
+    
+    // merge in job order
+    for (u32 worker_index = 0; worker_index < worker_count; ++worker_index) {
+        auto worker = workers + worker_index;
+        
+        for (u32 i = 0; i < worker->event_count; ++i)
+            push_collision_event(events, worker->events[i], bodies, arena);
+        
+        *pair_test_count += worker->pair_test_count;
+    }
+}
+
+// true if body_index is in [first_index, one_past_last_index)
+bool contains_body_index(u32 *first_index, u32 *one_past_last_index, u32 body_index)
+{
+    for (u32 *it = first_index; it != one_past_last_index; ++it) {
+        if (*it == body_index)
+            return true;
+    }
+    
+    return false;
+}
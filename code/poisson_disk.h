@@ -0,0 +1,222 @@
+#pragma once
+
+// poisson disk sampling (Robert Bridson, "Fast Poisson Disk Sampling in Arbitrary Dimensions"):
+// random points in the game area, no two closer than min_distance.
+// distances wrap around the area like the simulation does.
+// a background grid with at most one point per cell keeps each test local,
+// so sampling is linear in the point count.
+// needs physics.h (Game_Area) and random.h.
+
+#define Poisson_Disk_Attempt_Count 30
+#define Poisson_Disk_Empty_Cell    0xFFFFFFFF
+
+struct Poisson_Disk_Grid {
+    Game_Area area;
+    f32 min_distance;
+    
+    u32 column_count;
+    u32 row_count;
+    vec3f cell_extent;
+    
+    // cells that have to be checked around a cell in each direction
+    s32 search_column_count;
+    s32 search_row_count;
+    
+    // index into points or Poisson_Disk_Empty_Cell
+    u32 *cells;
+    
+    vec3f *points;
+    u32 point_count;
+    
+    // checked against every candidate, for blockers that do not fit into a cell
+    Sphere3f *obstacles;
+    u32 obstacle_count;
+};
+
+inline u32 get_poisson_disk_cell_index(Poisson_Disk_Grid *grid, vec3f point)
+{
+    vec3f offset = point - grid->area.bottem_left_corner;
+    
+    u32 x = MIN(cast_v(u32, MAX(0.0f, offset.x / grid->cell_extent.x)), grid->column_count - 1);
+    u32 y = MIN(cast_v(u32, MAX(0.0f, offset.y / grid->cell_extent.y)), grid->row_count - 1);
+    
+    return y * grid->column_count + x;
+}
+
+bool is_poisson_disk_point_free(Poisson_Disk_Grid *grid, vec3f point)
+{
+    for (u32 i = 0; i < grid->obstacle_count; ++i) {
+        f32 distance = grid->obstacles[i].radius + grid->min_distance * 0.5f;
+        
+        if (squared_length(minimum_image_distance(grid->area, point - grid->obstacles[i].center)) < distance * distance)
+            return false;
+    }
+    
+    u32 cell_index = get_poisson_disk_cell_index(grid, point);
+    s32 cell_x = cell_index % grid->column_count;
+    s32 cell_y = cell_index / grid->column_count;
+    
+    for (s32 dy = -grid->search_row_count; dy <= grid->search_row_count; ++dy) {
+        // wrap the cell and move the point by the same amount, cheaper than minimum_image_distance
+        s32 y = cell_y + dy;
+        f32 offset_y = 0.0f;
+        
+        while (y < 0) {
+            y += grid->row_count;
+            offset_y += grid->area.size.y;
+        }
+        
+        while (y >= cast_v(s32, grid->row_count)) {
+            y -= grid->row_count;
+            offset_y -= grid->area.size.y;
+        }
+        
+        for (s32 dx = -grid->search_column_count; dx <= grid->search_column_count; ++dx) {
+            s32 x = cell_x + dx;
+            f32 offset_x = 0.0f;
+            
+            while (x < 0) {
+                x += grid->column_count;
+                offset_x += grid->area.size.x;
+            }
+            
+            while (x >= cast_v(s32, grid->column_count)) {
+                x -= grid->column_count;
+                offset_x -= grid->area.size.x;
+            }
+            
+            u32 point_index = grid->cells[y * grid->column_count + x];
+            if (point_index == Poisson_Disk_Empty_Cell)
+                continue;
+            
+            vec3f distance = point - grid->points[point_index];
+            distance.x += offset_x;
+            distance.y += offset_y;
+            
+            if (squared_length(distance) < grid->min_distance * grid->min_distance)
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+// point has to be free
+void add_poisson_disk_point(Poisson_Disk_Grid *grid, vec3f point)
+{
+    u32 cell_index = get_poisson_disk_cell_index(grid, point);
+    assert(grid->cells[cell_index] == Poisson_Disk_Empty_Cell);
+    
+    grid->cells[cell_index] = grid->point_count;
+    grid->points[grid->point_count++] = point;
+}
+
+// writes up to max_count points to points and returns how many fit.
+// obstacles are kept free, a point is at least obstacle radius + min_distance / 2 away from them.
+// small obstacles are put into the grid, the others are tested brute force,
+// so only pass a few obstacles bigger than min_distance / 2.
+// allocator is only used for temporary memory.
+u32 sample_poisson_disk(vec3f *points, u32 max_count, Game_Area area, f32 min_distance, Sphere3f *obstacles, u32 obstacle_count, Random_Generator *random, Memory_Allocator *allocator)
+{
+    if (!max_count)
+        return 0;
+    
+    Poisson_Disk_Grid grid = {};
+    grid.area = area;
+    grid.min_distance = min_distance;
+    
+    // cell diagonal is at most min_distance, so two points never share a cell
+    f32 max_cell_size = min_distance * 0.70710678f;
+    grid.column_count = MAX(1, cast_v(u32, ceil(area.size.x / max_cell_size)));
+    grid.row_count    = MAX(1, cast_v(u32, ceil(area.size.y / max_cell_size)));
+    grid.cell_extent  = vec3f{ area.size.x / grid.column_count, area.size.y / grid.row_count, 0.0f };
+    
+    grid.search_column_count = cast_v(s32, ceil(min_distance / grid.cell_extent.x));
+    grid.search_row_count    = cast_v(s32, ceil(min_distance / grid.cell_extent.y));
+    
+    u32 cell_count = grid.column_count * grid.row_count;
+    grid.cells = ALLOCATE_ARRAY(allocator, u32, cell_count);
+    defer { free(allocator, grid.cells); };
+    
+    for (u32 i = 0; i < cell_count; ++i)
+        grid.cells[i] = Poisson_Disk_Empty_Cell;
+    
+    grid.points = ALLOCATE_ARRAY(allocator, vec3f, obstacle_count + max_count);
+    defer { free(allocator, grid.points); };
+    
+    grid.obstacles = ALLOCATE_ARRAY(allocator, Sphere3f, MAX(obstacle_count, 1));
+    defer { free(allocator, grid.obstacles); };
+    
+    for (u32 i = 0; i < obstacle_count; ++i) {
+        vec3f center = wrap_position(area, obstacles[i].center);
+        
+        if ((obstacles[i].radius <= min_distance * 0.5f) && (grid.cells[get_poisson_disk_cell_index(&grid, center)] == Poisson_Disk_Empty_Cell))
+            add_poisson_disk_point(&grid, center);
+        else
+            grid.obstacles[grid.obstacle_count++] = { center, obstacles[i].radius };
+    }
+    
+    u32 first_point_index = grid.point_count;
+    
+    // indices of points that may still have free space around them
+    u32 *active_indices = ALLOCATE_ARRAY(allocator, u32, max_count);
+    defer { free(allocator, active_indices); };
+    
+    u32 active_count = 0;
+    u32 count = 0;
+    
+    while (count < max_count) {
+        if (!active_count) {
+            // new seed, there can be free regions that the active points can not reach
+            bool found_seed = false;
+            
+            for (u32 attempt = 0; attempt < Poisson_Disk_Attempt_Count; ++attempt) {
+                vec3f point = area.bottem_left_corner;
+                point.x += random_f32(random, 0.0f, area.size.x);
+                point.y += random_f32(random, 0.0f, area.size.y);
+                point = wrap_position(area, point);
+                
+                if (is_poisson_disk_point_free(&grid, point)) {
+                    add_poisson_disk_point(&grid, point);
+                    active_indices[active_count++] = count++;
+                    found_seed = true;
+                    break;
+                }
+            }
+            
+            if (!found_seed)
+                break;
+            
+            continue;
+        }
+        
+        u32 active_index = random_index(random, active_count);
+        vec3f center = grid.points[first_point_index + active_indices[active_index]];
+        
+        bool found_point = false;
+        
+        for (u32 attempt = 0; attempt < Poisson_Disk_Attempt_Count; ++attempt) {
+            // separate statements, the evaluation order of arguments is unspecified
+            f32 angle = random_f32(random, 0.0f, 2 * PIf);
+            f32 distance = random_f32(random, min_distance, min_distance * 2.0f);
+            
+            vec3f point = center + vec3f{ cos(angle) * distance, sin(angle) * distance, 0.0f };
+            point = wrap_position(area, point);
+            
+            if (is_poisson_disk_point_free(&grid, point)) {
+                add_poisson_disk_point(&grid, point);
+                active_indices[active_count++] = count++;
+                found_point = true;
+                break;
+            }
+        }
+        
+        // no room left around center
+        if (!found_point)
+            active_indices[active_index] = active_indices[--active_count];
+    }
+    
+    COPY(points, grid.points + first_point_index, sizeof(vec3f) * count);
+    
+    return count;
+}
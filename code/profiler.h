@@ -0,0 +1,131 @@
+#pragma once
+
+// scoped timing zones, written as chrome trace_event json
+// (open in chrome://tracing or ui.perfetto.dev).
+// compiled out unless PROFILER_ENABLED is defined, see build.bat and build_headless.sh.
+//
+// usage:
+//     {
+//         PROFILE_SCOPE("narrowphase");
+//         ...
+//     }
+//
+// each worker index of run_workers records into its own ring buffer,
+// so recording needs no locks. when a ring buffer is full the oldest zones are overwritten.
+// only write the trace while no workers are running.
+
+#include <stdio.h>
+
+#if defined(PROFILER_ENABLED)
+
+#include <chrono>
+
+#define Profile_Thread_Count         Max_Worker_Count
+#define Profile_Ring_Buffer_Capacity (1 << 14)
+
+struct Profile_Zone {
+    const char *name;
+    u64 start_nanoseconds;
+    u64 end_nanoseconds;
+};
+
+struct Profile_Ring_Buffer {
+    Profile_Zone zones[Profile_Ring_Buffer_Capacity];
+    u32 next_index;
+    u32 count;
+};
+
+// one per worker index, set by run_workers
+thread_local u32 profile_thread_index;
+
+Profile_Ring_Buffer global_profile_ring_buffers[Profile_Thread_Count];
+
+inline u64 get_profile_nanoseconds()
+{
+    return cast_v(u64, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline void set_profile_thread_index(u32 thread_index)
+{
+    assert(thread_index < Profile_Thread_Count);
+    profile_thread_index = thread_index;
+}
+
+inline void push_profile_zone(const char *name, u64 start_nanoseconds, u64 end_nanoseconds)
+{
+    auto ring_buffer = global_profile_ring_buffers + profile_thread_index;
+    
+    ring_buffer->zones[ring_buffer->next_index] = { name, start_nanoseconds, end_nanoseconds };
+    ring_buffer->next_index = (ring_buffer->next_index + 1) % Profile_Ring_Buffer_Capacity;
+    ring_buffer->count = MIN(ring_buffer->count + 1, Profile_Ring_Buffer_Capacity);
+}
+
+struct Profile_Scope {
+    const char *name;
+    u64 start_nanoseconds;
+    
+    Profile_Scope(const char *name) : name(name), start_nanoseconds(get_profile_nanoseconds()) {}
+    
+    ~Profile_Scope() {
+        push_profile_zone(name, start_nanoseconds, get_profile_nanoseconds());
+    }
+};
+
+#define PROFILE_SCOPE_NAME2(line) profile_scope_ ## line
+#define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_NAME2(line)
+
+// name has to be a string literal or otherwise outlive the trace
+#define PROFILE_SCOPE(name) Profile_Scope PROFILE_SCOPE_NAME(__LINE__)(name)
+
+void clear_profile()
+{
+    for (u32 i = 0; i < Profile_Thread_Count; ++i) {
+        global_profile_ring_buffers[i].next_index = 0;
+        global_profile_ring_buffers[i].count = 0;
+    }
+}
+
+// writes all recorded zones, oldest first, and clears them
+bool write_profile_trace(const char *file_path)
+{
+    FILE *file = fopen(file_path, "w");
+    if (!file)
+        return false;
+    
+    defer { fclose(file); };
+    
+    fprintf(file, "{\"traceEvents\":[\n");
+    
+    bool is_first = true;
+    for (u32 thread_index = 0; thread_index < Profile_Thread_Count; ++thread_index) {
+        auto ring_buffer = global_profile_ring_buffers + thread_index;
+        u32 first_index = (ring_buffer->next_index + Profile_Ring_Buffer_Capacity - ring_buffer->count) % Profile_Ring_Buffer_Capacity;
+        
+        for (u32 i = 0; i < ring_buffer->count; ++i) {
+            auto zone = ring_buffer->zones + (first_index + i) % Profile_Ring_Buffer_Capacity;
+            
+            // timestamps and durations are in microseconds
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", is_first ? "" : ",\n", zone->name, thread_index, zone->start_nanoseconds / 1000.0, (zone->end_nanoseconds - zone->start_nanoseconds) / 1000.0);
+            
+            is_first = false;
+        }
+    }
+    
+    fprintf(file, "\n]}\n");
+    
+    clear_profile();
+    
+    return !ferror(file);
+}
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+inline void set_profile_thread_index(u32 thread_index) {}
+inline void clear_profile() {}
+
+// nothing to write without PROFILER_ENABLED
+inline bool write_profile_trace(const char *file_path) { return false; }
+
+#endif
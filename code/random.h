@@ -0,0 +1,60 @@
+#pragma once
+
+// seedable random number generator (pcg32 by Melissa O'Neill),
+// each simulation owns one instead of sharing the global rand(),
+// so runs with the same seed spawn the same game.
+
+struct Random_Generator {
+    u64 state;
+    u64 increment;
+};
+
+u32 random_u32(Random_Generator *generator)
+{
+    u64 old_state = generator->state;
+    generator->state = old_state * 6364136223846793005ULL + generator->increment;
+    
+    u32 xor_shifted = cast_v(u32, ((old_state >> 18) ^ old_state) >> 27);
+    u32 rotation = cast_v(u32, old_state >> 59);
+    
+    return (xor_shifted >> rotation) | (xor_shifted << ((-rotation) & 31));
+}
+
+Random_Generator make_random_generator(u64 seed, u64 sequence = 0x14057b7ef767814fULL)
+{
+    Random_Generator generator;
+    generator.state = 0;
+    // has to be odd
+    generator.increment = (sequence << 1) | 1;
+    
+    random_u32(&generator);
+    generator.state += seed;
+    random_u32(&generator);
+    
+    return generator;
+}
+
+// in [0, count), count > 0
+u32 random_index(Random_Generator *generator, u32 count)
+{
+    assert(count);
+    
+    // reject the 2^32 % count lowest values, so all results are equally likely
+    u32 threshold = (-count) % count;
+    
+    u32 value;
+    do {
+        value = random_u32(generator);
+    } while (value < threshold);
+    
+    return value % count;
+}
+
+// in [min, max]
+f32 random_f32(Random_Generator *generator, f32 min, f32 max)
+{
+    // 24 bits fit exactly into the f32 mantissa
+    f32 unit = (random_u32(generator) >> 8) * (1.0f / 16777215.0f);
+    
+    return min + (max - min) * unit;
+}
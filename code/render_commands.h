@@ -0,0 +1,242 @@
+#pragma once
+
+// render command list, the game records what to draw, the backend in main.cpp sorts
+// and submits it. recording does not touch gl, so it also runs headless.
+//
+// commands are sorted by a 64 bit key, most significant bits first:
+// opaque and overlay passes:  pass 4 | program 8 | material 12 | mesh 12 | depth 24 | 4 unused
+// transparent pass:           pass 4 | inverted depth 24 | program 8 | material 12 | mesh 12 | 4 unused
+// so opaque draws are grouped by state and front to back inside a state,
+// transparent draws go back to front. sorting is stable, equal keys keep their record order.
+// needs game.h.
+
+enum Render_Pass {
+    Render_Pass_Opaque,
+    Render_Pass_Transparent,
+    
+    // immediate mode debug draws on top of the scene
+    Render_Pass_Overlay,
+    
+    Render_Pass_Count,
+};
+
+// programs and materials of this game, the backend maps them to gl objects
+enum Render_Program {
+    Render_Program_Phong,
+    Render_Program_Water,
+    
+    // mooselib immediate render context, changes gl state on its own
+    Render_Program_Immediate,
+    
+    Render_Program_Count,
+};
+
+enum Render_Material {
+    Render_Material_None,
+    
+    // normal and ambient occlusion map
+    Render_Material_Asteroid,
+    
+    Render_Material_Count,
+};
+
+enum Render_Command_Kind {
+    // instances of Draw_Instance in the frame's instance buffer
+    Render_Command_Draw_Instances,
+    
+    // a single mesh with per draw uniforms
+    Render_Command_Draw_Mesh,
+    
+    // draw_and_flush of the immediate render context
+    Render_Command_Flush_Immediate,
+};
+
+// view distances beyond this share the last depth key
+#define Render_Max_Depth 1024.0f
+
+// keys only have 12 bits for mesh ids
+#define Render_Max_Mesh_Count 4096
+
+struct Render_Command {
+    u64 key;
+    
+    u32 kind;
+    u32 pass;
+    u32 program;
+    u32 material;
+    Mesh *mesh;
+    
+    // Render_Command_Draw_Instances
+    u32 first_instance;
+    u32 instance_count;
+    
+    // Render_Command_Draw_Mesh, ambient_color also for instances
+    mat4x3f object_to_world_transform;
+    vec4f ambient_color;
+    vec4f diffuse_color;
+    f32 shininess;
+    f32 phase;
+};
+
+#define Template_Array_Type      Render_Command_Buffer
+#define Template_Array_Data_Type Render_Command
+#define Template_Array_Is_Buffer
+#include "template_array.h"
+
+struct Render_Command_List {
+    // needs to support free in any order
+    Memory_Allocator *allocator;
+    
+    Render_Command_Buffer commands;
+    
+    // mesh id in keys is the index, in order of first use
+    Mesh *meshes[Render_Max_Mesh_Count];
+    u32 mesh_count;
+};
+
+void init_render_command_list(Render_Command_List *list, Memory_Allocator *allocator, u32 capacity = 64)
+{
+    list->allocator = allocator;
+    list->commands = ALLOCATE_ARRAY_INFO(allocator, Render_Command, capacity);
+    list->mesh_count = 0;
+}
+
+void free_render_command_list(Render_Command_List *list)
+{
+    free(list->allocator, list->commands.data);
+    list->commands = {};
+    list->mesh_count = 0;
+}
+
+// call once per frame before recording
+void clear_render_command_list(Render_Command_List *list)
+{
+    list->commands.count = 0;
+    list->mesh_count = 0;
+}
+
+u32 get_render_mesh_id(Render_Command_List *list, Mesh *mesh)
+{
+    // only a few meshes per frame
+    for (u32 i = 0; i < list->mesh_count; ++i) {
+        if (list->meshes[i] == mesh)
+            return i;
+    }
+    
+    assert(list->mesh_count < Render_Max_Mesh_Count);
+    list->meshes[list->mesh_count] = mesh;
+    
+    return list->mesh_count++;
+}
+
+// depth is the view distance
+u64 make_render_key(u32 pass, u32 program, u32 material, u32 mesh_id, f32 depth)
+{
+    assert(pass < 16);
+    assert(program < 256);
+    assert(material < 4096);
+    assert(mesh_id < 4096);
+    
+    u64 depth_bits = cast_v(u64, CLAMP(depth / Render_Max_Depth, 0.0f, 1.0f) * 0xFFFFFF);
+    
+    u64 state_bits = (cast_v(u64, program) << 24) | (cast_v(u64, material) << 12) | mesh_id;
+    
+    if (pass == Render_Pass_Transparent)
+        return (cast_v(u64, pass) << 60) | ((0xFFFFFF - depth_bits) << 36) | (state_bits << 4);
+    
+    return (cast_v(u64, pass) << 60) | (state_bits << 28) | (depth_bits << 4);
+}
+
+// returns a command with key set, fill the data of its kind
+Render_Command * push_render_command(Render_Command_List *list, u32 kind, u32 pass, u32 program, u32 material, Mesh *mesh, f32 depth)
+{
+    if (list->commands.count == list->commands.capacity) {
+        Render_Command_Buffer commands = ALLOCATE_ARRAY_INFO(list->allocator, Render_Command, MAX(list->commands.capacity * 2, 16));
+        COPY(commands.data, list->commands.data, sizeof(Render_Command) * list->commands.count);
+        commands.count = list->commands.count;
+        
+        free(list->allocator, list->commands.data);
+        list->commands = commands;
+    }
+    
+    u32 mesh_id = 0;
+    if (mesh)
+        mesh_id = get_render_mesh_id(list, mesh);
+    
+    Render_Command *command = push(&list->commands, {});
+    command->key      = make_render_key(pass, program, material, mesh_id, depth);
+    command->kind     = kind;
+    command->pass     = pass;
+    command->program  = program;
+    command->material = material;
+    command->mesh     = mesh;
+    
+    return command;
+}
+
+void record_draw_instances(Render_Command_List *list, u32 program, u32 material, Draw_Instance_Group_Buffer groups, vec4f ambient_color)
+{
+    for (auto group = first(groups); group != one_past_last(groups); ++group) {
+        // instances of a group are spread over the scene, no useful depth
+        Render_Command *command = push_render_command(list, Render_Command_Draw_Instances, Render_Pass_Opaque, program, material, group->mesh, 0.0f);
+        command->first_instance = group->first_instance;
+        command->instance_count = group->instance_count;
+        command->ambient_color  = ambient_color;
+    }
+}
+
+void record_draw_mesh(Render_Command_List *list, u32 pass, u32 program, u32 material, Mesh *mesh, mat4x3f object_to_world_transform, vec4f ambient_color, vec4f diffuse_color, f32 shininess, f32 phase, f32 depth)
+{
+    Render_Command *command = push_render_command(list, Render_Command_Draw_Mesh, pass, program, material, mesh, depth);
+    command->object_to_world_transform = object_to_world_transform;
+    command->ambient_color = ambient_color;
+    command->diffuse_color = diffuse_color;
+    command->shininess     = shininess;
+    command->phase         = phase;
+}
+
+void record_flush_immediate(Render_Command_List *list, u32 pass)
+{
+    push_render_command(list, Render_Command_Flush_Immediate, pass, Render_Program_Immediate, Render_Material_None, null, 0.0f);
+}
+
+// stable bottom up merge sort by key
+void sort_render_commands(Render_Command_List *list)
+{
+    PROFILE_SCOPE("sort render commands");
+    
+    u32 count = list->commands.count;
+    if (count < 2)
+        return;
+    
+    Render_Command *source = list->commands.data;
+    Render_Command *destination = ALLOCATE_ARRAY(list->allocator, Render_Command, count);
+    Render_Command *buffer = destination;
+    
+    for (u32 width = 1; width < count; width *= 2) {
+        for (u32 start = 0; start < count; start += width * 2) {
+            u32 middle = MIN(start + width, count);
+            u32 end    = MIN(start + width * 2, count);
+            
+            u32 left = start;
+            u32 right = middle;
+            
+            for (u32 i = start; i < end; ++i) {
+                // <= keeps equal keys in order
+                if ((left < middle) && ((right == end) || (source[left].key <= source[right].key)))
+                    destination[i] = source[left++];
+                else
+                    destination[i] = source[right++];
+            }
+        }
+        
+        Render_Command *temp = source;
+        source = destination;
+        destination = temp;
+    }
+    
+    if (source != list->commands.data)
+        COPY(list->commands.data, source, sizeof(Render_Command) * count);
+    
+    free(list->allocator, buffer);
+}
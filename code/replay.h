@@ -0,0 +1,131 @@
+#pragma once
+
+// records a game session as seed, start options and per frame input into a compact binary log,
+// and plays it back. the same binary and game area simulate the same game again.
+// needs game.h.
+//
+// file layout: Replay_Header, then header.frame_count Frame_Input (12 bytes each),
+// in the byte order of the recording machine.
+
+#include <stdio.h>
+
+#define Replay_Magic   0x4c505241 // "ARPL"
+#define Replay_Version 2
+
+struct Replay_Header {
+    u32 magic;
+    u32 version;
+    
+    u64 seed;
+    u32 asteroid_count;
+    u32 frame_count;
+    
+    Game_Area game_area;
+    Game_Options options;
+};
+
+struct Replay_Recorder {
+    FILE *file;
+    Replay_Header header;
+};
+
+struct Replay_Player {
+    Replay_Header header;
+    Frame_Input *frames;
+    u32 frame_index;
+};
+
+// call reset_game with header.seed and spawn header.asteroid_count asteroids at the same time
+bool start_recording(Replay_Recorder *recorder, const char *file_path, u64 seed, u32 asteroid_count, Game_Area game_area, Game_Options options)
+{
+    assert(!recorder->file);
+    
+    recorder->header = {};
+    recorder->header.magic          = Replay_Magic;
+    recorder->header.version        = Replay_Version;
+    recorder->header.seed           = seed;
+    recorder->header.asteroid_count = asteroid_count;
+    recorder->header.game_area      = game_area;
+    recorder->header.options        = options;
+    
+    recorder->file = fopen(file_path, "wb");
+    if (!recorder->file)
+        return false;
+    
+    // frame_count is written again when recording stops
+    if (fwrite(&recorder->header, sizeof(recorder->header), 1, recorder->file) != 1) {
+        fclose(recorder->file);
+        recorder->file = null;
+        return false;
+    }
+    
+    return true;
+}
+
+void record_frame(Replay_Recorder *recorder, Frame_Input input)
+{
+    assert(recorder->file);
+    
+    if (fwrite(&input, sizeof(input), 1, recorder->file) == 1)
+        ++recorder->header.frame_count;
+}
+
+void stop_recording(Replay_Recorder *recorder)
+{
+    assert(recorder->file);
+    
+    fseek(recorder->file, 0, SEEK_SET);
+    fwrite(&recorder->header, sizeof(recorder->header), 1, recorder->file);
+    fclose(recorder->file);
+    
+    recorder->file = null;
+}
+
+bool load_replay(Replay_Player *player, const char *file_path, Memory_Allocator *allocator)
+{
+    *player = {};
+    
+    FILE *file = fopen(file_path, "rb");
+    if (!file)
+        return false;
+    
+    defer { fclose(file); };
+    
+    if (fread(&player->header, sizeof(player->header), 1, file) != 1)
+        return false;
+    
+    if ((player->header.magic != Replay_Magic) || (player->header.version != Replay_Version))
+        return false;
+    
+    if (!player->header.frame_count)
+        return true;
+    
+    player->frames = ALLOCATE_ARRAY(allocator, Frame_Input, player->header.frame_count);
+    
+    if (fread(player->frames, sizeof(Frame_Input), player->header.frame_count, file) != player->header.frame_count) {
+        free(allocator, player->frames);
+        player->frames = null;
+        return false;
+    }
+    
+    return true;
+}
+
+void free_replay(Replay_Player *player, Memory_Allocator *allocator)
+{
+    if (player->frames)
+        free(allocator, player->frames);
+    
+    *player = {};
+}
+
+// returns false after the last frame
+bool next_replay_frame(Replay_Player *player, Frame_Input *input)
+{
+    if (player->frame_index >= player->header.frame_count)
+        return false;
+    
+    *input = player->frames[player->frame_index++];
+    
+    return true;
+}
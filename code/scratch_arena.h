@@ -0,0 +1,176 @@
+#pragma once
+
+// linear scratch memory with mark and rewind, used by the physics step.
+// reset_scratch_arena reserves one block as large as the high-water mark of the
+// last frame, so in steady state a frame does no allocator calls at all.
+// if a frame needs more, overflow blocks are allocated and released again
+// on rewind or at the next reset.
+//
+// arrays pushed through the arena grow to power of two capacities, starting
+// with Scratch_Arena_Min_Array_Capacity, so they only work with empty arrays
+// or arrays that only ever grew through the arena.
+// memory is released with rewind_scratch_arena, never with free.
+
+#define Scratch_Arena_Alignment          16
+#define Scratch_Arena_Min_Array_Capacity 16
+#define Scratch_Arena_Initial_Byte_Count KILO(256)
+
+struct Scratch_Arena_Block {
+    Scratch_Arena_Block *previous;
+    u8 *data;
+    u64 capacity;
+    u64 used;
+};
+
+struct Scratch_Arena {
+    // needs to support free in any order
+    Memory_Allocator *allocator;
+    
+    // newest block, the reserved block is the first in the list
+    Scratch_Arena_Block *current_block;
+    
+    // over all blocks
+    u64 used_byte_count;
+    
+    u64 high_water_byte_count;
+    u64 last_frame_high_water_byte_count;
+    u64 max_high_water_byte_count;
+    
+    // overflow blocks allocated since the last reset
+    u32 overflow_block_count;
+    u32 last_frame_overflow_block_count;
+};
+
+struct Scratch_Arena_Mark {
+    Scratch_Arena_Block *block;
+    u64 block_used;
+    u64 used_byte_count;
+};
+
+inline u64 align_scratch_byte_count(u64 byte_count)
+{
+    return (byte_count + Scratch_Arena_Alignment - 1) & ~cast_v(u64, Scratch_Arena_Alignment - 1);
+}
+
+Scratch_Arena_Block * allocate_scratch_arena_block(Memory_Allocator *allocator, u64 capacity, Scratch_Arena_Block *previous)
+{
+    // room to align data
+    u8 *memory = ALLOCATE_ARRAY(allocator, u8, sizeof(Scratch_Arena_Block) + Scratch_Arena_Alignment + capacity);
+    
+    auto block = cast_p(Scratch_Arena_Block, memory);
+    block->previous = previous;
+    block->data     = cast_p(u8, align_scratch_byte_count(cast_v(u64, memory + sizeof(Scratch_Arena_Block))));
+    block->capacity = capacity;
+    block->used     = 0;
+    
+    return block;
+}
+
+// allocator has to support free in any order, not a stack allocator
+void init_scratch_arena(Scratch_Arena *arena, Memory_Allocator *allocator, u64 reserved_byte_count = Scratch_Arena_Initial_Byte_Count)
+{
+    *arena = {};
+    arena->allocator = allocator;
+    arena->current_block = allocate_scratch_arena_block(allocator, align_scratch_byte_count(reserved_byte_count), null);
+}
+
+void * allocate_scratch(Scratch_Arena *arena, u64 byte_count)
+{
+    byte_count = align_scratch_byte_count(byte_count);
+    
+    auto block = arena->current_block;
+    
+    if (block->used + byte_count > block->capacity) {
+        block = allocate_scratch_arena_block(arena->allocator, MAX(byte_count, block->capacity), block);
+        arena->current_block = block;
+        ++arena->overflow_block_count;
+    }
+    
+    void *result = block->data + block->used;
+    block->used += byte_count;
+    
+    arena->used_byte_count += byte_count;
+    arena->high_water_byte_count = MAX(arena->high_water_byte_count, arena->used_byte_count);
+    
+    return result;
+}
+
+#define ALLOCATE_SCRATCH_ARRAY(arena, type, count) cast_p(type, allocate_scratch(arena, sizeof(type) * (count)))
+
+Scratch_Arena_Mark get_scratch_arena_mark(Scratch_Arena *arena)
+{
+    Scratch_Arena_Mark mark;
+    mark.block           = arena->current_block;
+    mark.block_used      = arena->current_block->used;
+    mark.used_byte_count = arena->used_byte_count;
+    
+    return mark;
+}
+
+// releases everything allocated after mark
+void rewind_scratch_arena(Scratch_Arena *arena, Scratch_Arena_Mark mark)
+{
+    while (arena->current_block != mark.block) {
+        auto previous = arena->current_block->previous;
+        free(arena->allocator, arena->current_block);
+        arena->current_block = previous;
+    }
+    
+    arena->current_block->used = mark.block_used;
+    arena->used_byte_count = mark.used_byte_count;
+}
+
+// call once per frame, releases everything and grows the reserved block
+// to the high-water mark of the finished frame
+void reset_scratch_arena(Scratch_Arena *arena)
+{
+    Scratch_Arena_Block *reserved_block = arena->current_block;
+    while (reserved_block->previous)
+        reserved_block = reserved_block->previous;
+    
+    Scratch_Arena_Mark start = {};
+    start.block = reserved_block;
+    rewind_scratch_arena(arena, start);
+    
+    if (arena->high_water_byte_count > reserved_block->capacity) {
+        // some head room, so slowly growing levels do not overflow every frame
+        u64 capacity = align_scratch_byte_count(arena->high_water_byte_count + arena->high_water_byte_count / 4);
+        
+        free(arena->allocator, reserved_block);
+        arena->current_block = allocate_scratch_arena_block(arena->allocator, capacity, null);
+    }
+    
+    arena->last_frame_high_water_byte_count = arena->high_water_byte_count;
+    arena->max_high_water_byte_count = MAX(arena->max_high_water_byte_count, arena->high_water_byte_count);
+    arena->high_water_byte_count = 0;
+    
+    arena->last_frame_overflow_block_count = arena->overflow_block_count;
+    arena->overflow_block_count = 0;
+}
+
+// including the current frame
+inline u64 get_max_high_water_byte_count(Scratch_Arena *arena)
+{
+    return MAX(arena->max_high_water_byte_count, arena->high_water_byte_count);
+}
+
+// push for template arrays, see above
+template <typename Array_Type, typename Data_Type>
+void push(Array_Type *array, Data_Type item, Scratch_Arena *arena)
+{
+    u32 count = array->count;
+    
+    // full if count is 0 or a power of two capacity
+    if (!count || ((count >= Scratch_Arena_Min_Array_Capacity) && !(count & (count - 1)))) {
+        u32 capacity = count ? count * 2 : Scratch_Arena_Min_Array_Capacity;
+        
+        auto data = static_cast<decltype(array->data)>(allocate_scratch(arena, sizeof(array->data[0]) * capacity));
+        
+        if (count)
+            COPY(data, array->data, sizeof(array->data[0]) * count);
+        
+        array->data = data;
+    }
+    
+    array->data[array->count++] = item;
+}
@@ -0,0 +1,358 @@
+#pragma once
+
+// shader variants with an on-disk cache of their linked programs.
+// a variant is a shader file compiled with the defines of a Shader_Option bit mask.
+// linked programs are written with glGetProgramBinary to a file named after the variant key,
+// a hash of the sources, defines, attribute locations and driver, so the next start loads the
+// binary instead of compiling. a variant that keeps its key keeps its program, so hot reloads
+// skip unchanged shaders. binaries of old keys are not deleted.
+// program binaries need gl 4.1 or ARB_get_program_binary, without them variants are compiled.
+// needs gl and light_clusters.h (Light_Data_*).
+
+// the options of data/shaders/*.shader.txt, see their OPTIONS section
+enum Shader_Option {
+    Shader_Option_Diffuse_Color,
+    Shader_Option_Diffuse_Texture,
+    Shader_Option_Normal_Map,
+    Shader_Option_Tangent_Transform_Per_Fragment,
+    Shader_Option_Instancing,
+    Shader_Option_Light_Clusters,
+    
+    Shader_Option_Count,
+};
+
+#define Shader_Option_Bit(option) (1 << (option))
+
+string const Shader_Option_Defines[Shader_Option_Count] = {
+    S("#define WITH_DIFFUSE_COLOR\n"),
+    S("#define WITH_DIFFUSE_TEXTURE\n"),
+    S("#define WITH_NORMAL_MAP\n"),
+    S("#define TANGENT_TRANSFORM_PER_FRAGMENT\n"),
+    S("#define WITH_INSTANCING\n"),
+    S("#define WITH_LIGHT_CLUSTERS\n"),
+};
+
+// change when the cache file layout changes
+#define Shader_Cache_Magic 0x31435348 // "HSC1"
+
+#define Shader_Max_Uniform_Name_Length 128
+
+#define Shader_Max_Generated_Defines_Length 512
+
+struct Shader_Cache_Header {
+    u32 magic;
+    GLenum binary_format;
+    
+    // checked again, in case two keys map to the same file name
+    u64 key;
+    
+    u32 byte_count;
+    u32 padding;
+};
+
+struct Shader_Variant {
+    GLuint program_object;
+    
+    // 0 if the variant was never loaded
+    u64 key;
+};
+
+// fnv-1a
+u64 hash_shader_bytes(u64 hash, void const *data, u32 byte_count)
+{
+    u8 const *bytes = cast_p(u8 const, data);
+    
+    for (u32 i = 0; i < byte_count; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    
+    return hash;
+}
+
+u64 hash_shader_string(u64 hash, char const *text)
+{
+    if (!text)
+        return hash;
+    
+    // include the terminator, so "ab" "c" and "a" "bc" differ
+    return hash_shader_bytes(hash, text, cast_v(u32, strlen(text)) + 1);
+}
+
+bool shader_program_binaries_are_supported()
+{
+    if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+        return false;
+    
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    
+    return (format_count > 0);
+}
+
+// uniform_names is comma separated, like the names passed to make_shader_program
+void get_shader_uniform_locations(GLuint program_object, string uniform_names, GLint *uniforms, u32 uniform_count)
+{
+    u32 uniform_index = 0;
+    u32 offset = 0;
+    
+    while (offset < uniform_names.count) {
+        char name[Shader_Max_Uniform_Name_Length];
+        u32 name_length = 0;
+        
+        for (; (offset < uniform_names.count) && (uniform_names.data[offset] != ','); ++offset) {
+            char c = uniform_names.data[offset];
+            
+            if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\\'))
+                continue;
+            
+            assert(name_length + 1 < Shader_Max_Uniform_Name_Length);
+            name[name_length++] = c;
+        }
+        
+        // skip ','
+        ++offset;
+        
+        if (!name_length)
+            continue;
+        
+        name[name_length] = '\0';
+        
+        assert(uniform_index < uniform_count);
+        uniforms[uniform_index++] = glGetUniformLocation(program_object, name);
+    }
+    
+    assert(uniform_index == uniform_count);
+}
+
+// 0 if there is no valid binary for key
+GLuint load_shader_program_binary(char const *file_path, u64 key, Memory_Allocator *allocator)
+{
+    FILE *file = fopen(file_path, "rb");
+    if (!file)
+        return 0;
+    
+    defer { fclose(file); };
+    
+    Shader_Cache_Header header;
+    if ((fread(&header, sizeof(header), 1, file) != 1) || (header.magic != Shader_Cache_Magic) || (header.key != key) || !header.byte_count)
+        return 0;
+    
+    u8 *binary = ALLOCATE_ARRAY(allocator, u8, header.byte_count);
+    defer { free(allocator, binary); };
+    
+    if (fread(binary, header.byte_count, 1, file) != 1)
+        return 0;
+    
+    GLuint program_object = glCreateProgram();
+    glProgramBinary(program_object, header.binary_format, binary, header.byte_count);
+    
+    // drivers reject binaries of other versions, even with the same key
+    GLint link_status = GL_FALSE;
+    glGetProgramiv(program_object, GL_LINK_STATUS, &link_status);
+    
+    if (!link_status) {
+        glDeleteProgram(program_object);
+        return 0;
+    }
+    
+    return program_object;
+}
+
+// program_object has to be linked by link_shader_variant_program with binary_is_retrievable
+void save_shader_program_binary(char const *file_path, u64 key, GLuint program_object, Memory_Allocator *allocator)
+{
+    GLint byte_count = 0;
+    glGetProgramiv(program_object, GL_PROGRAM_BINARY_LENGTH, &byte_count);
+    
+    if (byte_count <= 0)
+        return;
+    
+    u8 *binary = ALLOCATE_ARRAY(allocator, u8, byte_count);
+    defer { free(allocator, binary); };
+    
+    Shader_Cache_Header header = {};
+    header.magic = Shader_Cache_Magic;
+    header.key = key;
+    
+    GLsizei written_byte_count = 0;
+    glGetProgramBinary(program_object, byte_count, &written_byte_count, &header.binary_format, binary);
+    
+    if (written_byte_count <= 0)
+        return;
+    
+    header.byte_count = written_byte_count;
+    
+    FILE *file = fopen(file_path, "wb");
+    if (!file)
+        return;
+    
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1) && (fwrite(binary, header.byte_count, 1, file) == 1);
+    fclose(file);
+    
+    // a partial file would only fail to load, but do not leave it around
+    if (!ok)
+        remove(file_path);
+}
+
+// like make_shader_program, but with binary_is_retrievable the program is linked with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT, without it drivers may return no binary.
+// deletes the shader objects
+GLuint link_shader_variant_program(GLuint *shader_objects, u32 shader_object_count, bool binary_is_retrievable, Shader_Attribute_Info *attributes, u32 attribute_count, string uniform_names, GLint *uniforms, u32 uniform_count)
+{
+    GLuint program_object = glCreateProgram();
+    
+    for (u32 i = 0; i < shader_object_count; ++i)
+        glAttachShader(program_object, shader_objects[i]);
+    
+    for (u32 i = 0; i < attribute_count; ++i)
+        glBindAttribLocation(program_object, attributes[i].index, attributes[i].name);
+    
+    if (binary_is_retrievable)
+        glProgramParameteri(program_object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    
+    glLinkProgram(program_object);
+    
+    for (u32 i = 0; i < shader_object_count; ++i) {
+        glDetachShader(program_object, shader_objects[i]);
+        glDeleteShader(shader_objects[i]);
+    }
+    
+    GLint link_status = GL_FALSE;
+    glGetProgramiv(program_object, GL_LINK_STATUS, &link_status);
+    
+    if (!link_status) {
+        char info_log[1024];
+        glGetProgramInfoLog(program_object, sizeof(info_log), null, info_log);
+        printf("shader program link error:\n%s\n", info_log);
+        
+        glDeleteProgram(program_object);
+        return 0;
+    }
+    
+    get_shader_uniform_locations(program_object, uniform_names, uniforms, uniform_count);
+    
+    return program_object;
+}
+
+// loads the variant of source with the defines of options, from the cache if possible.
+// keeps variant->program_object if the key did not change.
+// returns true if variant->program_object changed, uniforms are set then, and the caller has to
+// bind uniform blocks and sampler units again, programs from binaries start without them.
+// cache_file_path_format gets the key as %016llx.
+bool load_shader_variant(Shader_Variant *variant, string source, u32 options, Shader_Attribute_Info *attributes, u32 attribute_count, string uniform_names, GLint *uniforms, u32 uniform_count, char const *cache_file_path_format, Memory_Allocator *allocator)
+{
+    PROFILE_SCOPE("load shader variant");
+    
+    // version, option defines, generated defines, stage define, source
+    string vertex_shader_sources[Shader_Option_Count + 4];
+    string fragment_shader_sources[Shader_Option_Count + 4];
+    u32 source_count = 0;
+    
+    vertex_shader_sources[source_count] = S("#version 150\n");
+    fragment_shader_sources[source_count++] = S("#version 150\n");
+    
+    for (u32 option = 0; option < Shader_Option_Count; ++option) {
+        if (options & Shader_Option_Bit(option)) {
+            vertex_shader_sources[source_count] = Shader_Option_Defines[option];
+            fragment_shader_sources[source_count++] = Shader_Option_Defines[option];
+        }
+    }
+    
+    // the light data layout of light_clusters.h, so the shaders can not drift from it
+    char generated_defines[Shader_Max_Generated_Defines_Length];
+    
+    if (options & Shader_Option_Bit(Shader_Option_Light_Clusters)) {
+        int length = snprintf(generated_defines, sizeof(generated_defines),
+            "#define LIGHT_DATA_STRIDE %d\n"
+            "#define LIGHT_DATA_WORLD_POSITION_AND_ATTENUATION %d\n"
+            "#define LIGHT_DATA_DIFFUSE_COLOR %d\n"
+            "#define LIGHT_DATA_SPECULAR_COLOR %d\n"
+            "#define LIGHT_DATA_RADIUS %d\n",
+            Light_Data_Stride, Light_Data_World_Position_And_Attenuation, Light_Data_Diffuse_Color, Light_Data_Specular_Color, Light_Data_Radius);
+        
+        assert((length > 0) && (length < Shader_Max_Generated_Defines_Length));
+        
+        string defines;
+        defines.data  = cast_p(u8, generated_defines);
+        defines.count = length;
+        
+        vertex_shader_sources[source_count] = defines;
+        fragment_shader_sources[source_count++] = defines;
+    }
+    
+    u64 key = 0xCBF29CE484222325ull;
+    
+    for (u32 i = 0; i < source_count; ++i)
+        key = hash_shader_bytes(key, vertex_shader_sources[i].data, vertex_shader_sources[i].count);
+    
+    key = hash_shader_bytes(key, source.data, source.count);
+    
+    // locations are baked into binaries
+    for (u32 i = 0; i < attribute_count; ++i) {
+        key = hash_shader_bytes(key, &attributes[i].index, sizeof(attributes[i].index));
+        key = hash_shader_string(key, attributes[i].name);
+    }
+    
+    // binaries only load on the driver that made them
+    key = hash_shader_string(key, cast_p(char const, glGetString(GL_VENDOR)));
+    key = hash_shader_string(key, cast_p(char const, glGetString(GL_RENDERER)));
+    key = hash_shader_string(key, cast_p(char const, glGetString(GL_VERSION)));
+    
+    if (variant->program_object && (variant->key == key))
+        return false;
+    
+    vertex_shader_sources[source_count] = S("#define VERTEX_SHADER\n");
+    fragment_shader_sources[source_count++] = S("#define FRAGMENT_SHADER\n");
+    
+    vertex_shader_sources[source_count] = source;
+    fragment_shader_sources[source_count++] = source;
+    
+    bool use_binaries = shader_program_binaries_are_supported();
+    
+    char cache_file_path[256];
+    snprintf(cache_file_path, sizeof(cache_file_path), cache_file_path_format, cast_v(unsigned long long, key));
+    
+    GLuint program_object = 0;
+    
+    if (use_binaries) {
+        program_object = load_shader_program_binary(cache_file_path, key, allocator);
+        
+        if (program_object)
+            get_shader_uniform_locations(program_object, uniform_names, uniforms, uniform_count);
+    }
+    
+    if (!program_object) {
+        GLuint shader_objects[2];
+        shader_objects[0] = make_shader_object(GL_VERTEX_SHADER, vertex_shader_sources, source_count, allocator);
+        shader_objects[1] = make_shader_object(GL_FRAGMENT_SHADER, fragment_shader_sources, source_count, allocator);
+        
+        if (!shader_objects[0] || !shader_objects[1]) {
+            // the other stage may have compiled
+            for (u32 i = 0; i < ARRAY_COUNT(shader_objects); ++i) {
+                if (shader_objects[i])
+                    glDeleteShader(shader_objects[i]);
+            }
+            
+            return false;
+        }
+        
+        program_object = link_shader_variant_program(ARRAY_WITH_COUNT(shader_objects), use_binaries, attributes, attribute_count, uniform_names, uniforms, uniform_count);
+        
+        if (!program_object)
+            return false;
+        
+        if (use_binaries)
+            save_shader_program_binary(cache_file_path, key, program_object, allocator);
+    }
+    
+    if (variant->program_object) {
+        glUseProgram(0);
+        glDeleteProgram(variant->program_object);
+    }
+    
+    variant->program_object = program_object;
+    variant->key = key;
+    
+    return true;
+}
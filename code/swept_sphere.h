@@ -0,0 +1,292 @@
+#pragma once
+
+// batched swept sphere test:
+// one moving sphere against many other spheres stored as SoA,
+// all spheres move in the xy plane of a wrapped game area (z is ignored).
+// the AVX2 or SSE2 paths are picked at compile time,
+// they do the same operations in the same order as the scalar path,
+// so all paths give bit identical results (as long as the compiler does not
+// contract mul + add into fma, e.g. use -ffp-contract=off with gcc/clang).
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define SWEPT_SPHERE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define SWEPT_SPHERE_SSE2
+#endif
+
+// fraction of the sweep, if it can reach more than the nearest wrapped image,
+// callers have to use the scalar narrowphase with all images instead
+#define Swept_Sphere_Needs_All_Images -1.0f
+
+struct Swept_Sphere_Batch {
+    f32 *center_x;
+    f32 *center_y;
+    f32 *velocity_x;
+    f32 *velocity_y;
+    f32 *radius;
+    u32 count;
+};
+
+// fraction d of the relative sweep from distance until the spheres are margin apart,
+// 1 if they do not collide within the sweep.
+// same cases as the narrowphase always had, written to match the lanes of the batched kernel.
+inline f32 get_swept_sphere_fraction(f32 distance_x, f32 distance_y, f32 sweep_x, f32 sweep_y, f32 radius, f32 relative_margin)
+{
+    f32 a = sweep_x * sweep_x + sweep_y * sweep_y;
+    f32 b = distance_x * sweep_x + distance_y * sweep_y;
+    f32 c = (distance_x * distance_x + distance_y * distance_y) - radius * radius;
+    f32 discriminant = b * b - a * c;
+    
+    // no or only a touching collision
+    if (!(discriminant > 0.0f))
+        return 1.0f;
+    
+    f32 root = sqrt(discriminant);
+    f32 t0 = (-b - root) / a;
+    f32 t1 = (-b + root) / a;
+    
+    // relative_margin can be bigger than 1 for short movements
+    if (t0 > 0.0f)
+        return CLAMP(t0 - relative_margin, 0.0f, 1.0f);
+    
+    // spheres are overlapping and did not pass through each other yet,
+    // dont rewind, just ignore small overlaps and reflect
+    if ((t1 >= 0.0f) && (-t0 < t1))
+        return 0.0f;
+    
+    return 1.0f;
+}
+
+// one lane of the batched kernel, used for the remainder and without SIMD
+inline f32 get_swept_sphere_fraction(f32 moving_x, f32 moving_y, f32 moving_velocity_x, f32 moving_velocity_y, f32 moving_radius, f32 center_x, f32 center_y, f32 velocity_x, f32 velocity_y, f32 radius, f32 area_size_x, f32 area_size_y, f32 timestep, f32 margin)
+{
+    f32 movement_x = moving_velocity_x - velocity_x;
+    f32 movement_y = moving_velocity_y - velocity_y;
+    
+    f32 squared_movement_length = movement_x * movement_x + movement_y * movement_y;
+    
+    if (squared_movement_length == 0.0f)
+        return 1.0f;
+    
+    f32 relative_margin = margin / (timestep * sqrt(squared_movement_length));
+    
+    f32 distance_x = moving_x - center_x;
+    f32 distance_y = moving_y - center_y;
+    
+    // minimum image
+    distance_x -= area_size_x * floor(distance_x / area_size_x + 0.5f);
+    distance_y -= area_size_y * floor(distance_y / area_size_y + 0.5f);
+    
+    f32 sweep_x = movement_x * timestep;
+    f32 sweep_y = movement_y * timestep;
+    
+    f32 sum_radius = moving_radius + radius;
+    f32 extent = sum_radius + margin;
+    
+    f32 min_x = MIN(distance_x, distance_x + sweep_x) - extent;
+    f32 max_x = MAX(distance_x, distance_x + sweep_x) + extent;
+    f32 min_y = MIN(distance_y, distance_y + sweep_y) - extent;
+    f32 max_y = MAX(distance_y, distance_y + sweep_y) + extent;
+    
+    f32 min_image_x = min_x / area_size_x;
+    f32 max_image_x = max_x / area_size_x;
+    f32 min_image_y = min_y / area_size_y;
+    f32 max_image_y = max_y / area_size_y;
+    
+    if ((min_image_x <= -1.0f) || (max_image_x >= 1.0f) || (min_image_y <= -1.0f) || (max_image_y >= 1.0f))
+        return Swept_Sphere_Needs_All_Images;
+    
+    // sweep can not reach the nearest image
+    if ((min_image_x > 0.0f) || (max_image_x < 0.0f) || (min_image_y > 0.0f) || (max_image_y < 0.0f))
+        return 1.0f;
+    
+    return get_swept_sphere_fraction(distance_x, distance_y, sweep_x, sweep_y, sum_radius, relative_margin);
+}
+
+#if defined(SWEPT_SPHERE_SSE2)
+
+// SSE2 has no floor, exact for |value| < 2^31
+inline __m128 floor_ps(__m128 value) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+    __m128 one = _mm_set1_ps(1.0f);
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), one));
+}
+
+inline __m128 select_ps(__m128 mask, __m128 if_true, __m128 if_false) {
+    return _mm_or_ps(_mm_and_ps(mask, if_true), _mm_andnot_ps(mask, if_false));
+}
+
+#endif
+
+// writes get_swept_sphere_fraction of the moving sphere against each batch sphere to fractions
+void get_swept_sphere_fractions(f32 *fractions, Sphere3f moving_sphere, vec3f moving_velocity, Swept_Sphere_Batch batch, vec3f area_size, f32 timestep, f32 margin)
+{
+    u32 i = 0;
+    
+#if defined(SWEPT_SPHERE_AVX2)
+    
+    __m256 moving_x          = _mm256_set1_ps(moving_sphere.center.x);
+    __m256 moving_y          = _mm256_set1_ps(moving_sphere.center.y);
+    __m256 moving_velocity_x = _mm256_set1_ps(moving_velocity.x);
+    __m256 moving_velocity_y = _mm256_set1_ps(moving_velocity.y);
+    __m256 moving_radius     = _mm256_set1_ps(moving_sphere.radius);
+    __m256 area_size_x       = _mm256_set1_ps(area_size.x);
+    __m256 area_size_y       = _mm256_set1_ps(area_size.y);
+    __m256 timestep_8        = _mm256_set1_ps(timestep);
+    __m256 margin_8          = _mm256_set1_ps(margin);
+    __m256 zero              = _mm256_setzero_ps();
+    __m256 half              = _mm256_set1_ps(0.5f);
+    __m256 one               = _mm256_set1_ps(1.0f);
+    __m256 minus_one         = _mm256_set1_ps(-1.0f);
+    __m256 needs_all_images  = _mm256_set1_ps(Swept_Sphere_Needs_All_Images);
+    
+    for (; i + 8 <= batch.count; i += 8) {
+        __m256 movement_x = _mm256_sub_ps(moving_velocity_x, _mm256_loadu_ps(batch.velocity_x + i));
+        __m256 movement_y = _mm256_sub_ps(moving_velocity_y, _mm256_loadu_ps(batch.velocity_y + i));
+        
+        __m256 squared_movement_length = _mm256_add_ps(_mm256_mul_ps(movement_x, movement_x), _mm256_mul_ps(movement_y, movement_y));
+        __m256 is_moving = _mm256_cmp_ps(squared_movement_length, zero, _CMP_NEQ_OQ);
+        
+        __m256 relative_margin = _mm256_div_ps(margin_8, _mm256_mul_ps(timestep_8, _mm256_sqrt_ps(squared_movement_length)));
+        
+        __m256 distance_x = _mm256_sub_ps(moving_x, _mm256_loadu_ps(batch.center_x + i));
+        __m256 distance_y = _mm256_sub_ps(moving_y, _mm256_loadu_ps(batch.center_y + i));
+        
+        distance_x = _mm256_sub_ps(distance_x, _mm256_mul_ps(area_size_x, _mm256_floor_ps(_mm256_add_ps(_mm256_div_ps(distance_x, area_size_x), half))));
+        distance_y = _mm256_sub_ps(distance_y, _mm256_mul_ps(area_size_y, _mm256_floor_ps(_mm256_add_ps(_mm256_div_ps(distance_y, area_size_y), half))));
+        
+        __m256 sweep_x = _mm256_mul_ps(movement_x, timestep_8);
+        __m256 sweep_y = _mm256_mul_ps(movement_y, timestep_8);
+        
+        __m256 sum_radius = _mm256_add_ps(moving_radius, _mm256_loadu_ps(batch.radius + i));
+        __m256 extent = _mm256_add_ps(sum_radius, margin_8);
+        
+        __m256 end_x = _mm256_add_ps(distance_x, sweep_x);
+        __m256 end_y = _mm256_add_ps(distance_y, sweep_y);
+        
+        __m256 min_image_x = _mm256_div_ps(_mm256_sub_ps(_mm256_min_ps(distance_x, end_x), extent), area_size_x);
+        __m256 max_image_x = _mm256_div_ps(_mm256_add_ps(_mm256_max_ps(distance_x, end_x), extent), area_size_x);
+        __m256 min_image_y = _mm256_div_ps(_mm256_sub_ps(_mm256_min_ps(distance_y, end_y), extent), area_size_y);
+        __m256 max_image_y = _mm256_div_ps(_mm256_add_ps(_mm256_max_ps(distance_y, end_y), extent), area_size_y);
+        
+        __m256 reaches_other_images = _mm256_or_ps(
+            _mm256_or_ps(_mm256_cmp_ps(min_image_x, minus_one, _CMP_LE_OQ), _mm256_cmp_ps(max_image_x, one, _CMP_GE_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(min_image_y, minus_one, _CMP_LE_OQ), _mm256_cmp_ps(max_image_y, one, _CMP_GE_OQ)));
+        
+        __m256 reaches_nearest_image = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(min_image_x, zero, _CMP_LE_OQ), _mm256_cmp_ps(max_image_x, zero, _CMP_GE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(min_image_y, zero, _CMP_LE_OQ), _mm256_cmp_ps(max_image_y, zero, _CMP_GE_OQ)));
+        
+        // roots
+        __m256 a = _mm256_add_ps(_mm256_mul_ps(sweep_x, sweep_x), _mm256_mul_ps(sweep_y, sweep_y));
+        __m256 b = _mm256_add_ps(_mm256_mul_ps(distance_x, sweep_x), _mm256_mul_ps(distance_y, sweep_y));
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(distance_x, distance_x), _mm256_mul_ps(distance_y, distance_y)), _mm256_mul_ps(sum_radius, sum_radius));
+        __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+        
+        __m256 has_two_roots = _mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ);
+        
+        __m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+        __m256 minus_b = _mm256_sub_ps(zero, b);
+        __m256 t0 = _mm256_div_ps(_mm256_sub_ps(minus_b, root), a);
+        __m256 t1 = _mm256_div_ps(_mm256_add_ps(minus_b, root), a);
+        
+        __m256 approaching_fraction = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(t0, relative_margin), zero), one);
+        
+        __m256 is_overlapping = _mm256_and_ps(_mm256_cmp_ps(t1, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_sub_ps(zero, t0), t1, _CMP_LT_OQ));
+        __m256 overlapping_fraction = _mm256_blendv_ps(one, zero, is_overlapping);
+        
+        __m256 fraction = _mm256_blendv_ps(overlapping_fraction, approaching_fraction, _mm256_cmp_ps(t0, zero, _CMP_GT_OQ));
+        fraction = _mm256_blendv_ps(one, fraction, _mm256_and_ps(has_two_roots, reaches_nearest_image));
+        fraction = _mm256_blendv_ps(fraction, needs_all_images, reaches_other_images);
+        fraction = _mm256_blendv_ps(one, fraction, is_moving);
+        
+        _mm256_storeu_ps(fractions + i, fraction);
+    }
+    
+#elif defined(SWEPT_SPHERE_SSE2)
+    
+    __m128 moving_x          = _mm_set1_ps(moving_sphere.center.x);
+    __m128 moving_y          = _mm_set1_ps(moving_sphere.center.y);
+    __m128 moving_velocity_x = _mm_set1_ps(moving_velocity.x);
+    __m128 moving_velocity_y = _mm_set1_ps(moving_velocity.y);
+    __m128 moving_radius     = _mm_set1_ps(moving_sphere.radius);
+    __m128 area_size_x       = _mm_set1_ps(area_size.x);
+    __m128 area_size_y       = _mm_set1_ps(area_size.y);
+    __m128 timestep_4        = _mm_set1_ps(timestep);
+    __m128 margin_4          = _mm_set1_ps(margin);
+    __m128 zero              = _mm_setzero_ps();
+    __m128 half              = _mm_set1_ps(0.5f);
+    __m128 one               = _mm_set1_ps(1.0f);
+    __m128 minus_one         = _mm_set1_ps(-1.0f);
+    __m128 needs_all_images  = _mm_set1_ps(Swept_Sphere_Needs_All_Images);
+    
+    for (; i + 4 <= batch.count; i += 4) {
+        __m128 movement_x = _mm_sub_ps(moving_velocity_x, _mm_loadu_ps(batch.velocity_x + i));
+        __m128 movement_y = _mm_sub_ps(moving_velocity_y, _mm_loadu_ps(batch.velocity_y + i));
+        
+        __m128 squared_movement_length = _mm_add_ps(_mm_mul_ps(movement_x, movement_x), _mm_mul_ps(movement_y, movement_y));
+        __m128 is_moving = _mm_cmpneq_ps(squared_movement_length, zero);
+        
+        __m128 relative_margin = _mm_div_ps(margin_4, _mm_mul_ps(timestep_4, _mm_sqrt_ps(squared_movement_length)));
+        
+        __m128 distance_x = _mm_sub_ps(moving_x, _mm_loadu_ps(batch.center_x + i));
+        __m128 distance_y = _mm_sub_ps(moving_y, _mm_loadu_ps(batch.center_y + i));
+        
+        distance_x = _mm_sub_ps(distance_x, _mm_mul_ps(area_size_x, floor_ps(_mm_add_ps(_mm_div_ps(distance_x, area_size_x), half))));
+        distance_y = _mm_sub_ps(distance_y, _mm_mul_ps(area_size_y, floor_ps(_mm_add_ps(_mm_div_ps(distance_y, area_size_y), half))));
+        
+        __m128 sweep_x = _mm_mul_ps(movement_x, timestep_4);
+        __m128 sweep_y = _mm_mul_ps(movement_y, timestep_4);
+        
+        __m128 sum_radius = _mm_add_ps(moving_radius, _mm_loadu_ps(batch.radius + i));
+        __m128 extent = _mm_add_ps(sum_radius, margin_4);
+        
+        __m128 end_x = _mm_add_ps(distance_x, sweep_x);
+        __m128 end_y = _mm_add_ps(distance_y, sweep_y);
+        
+        __m128 min_image_x = _mm_div_ps(_mm_sub_ps(_mm_min_ps(distance_x, end_x), extent), area_size_x);
+        __m128 max_image_x = _mm_div_ps(_mm_add_ps(_mm_max_ps(distance_x, end_x), extent), area_size_x);
+        __m128 min_image_y = _mm_div_ps(_mm_sub_ps(_mm_min_ps(distance_y, end_y), extent), area_size_y);
+        __m128 max_image_y = _mm_div_ps(_mm_add_ps(_mm_max_ps(distance_y, end_y), extent), area_size_y);
+        
+        __m128 reaches_other_images = _mm_or_ps(
+            _mm_or_ps(_mm_cmple_ps(min_image_x, minus_one), _mm_cmpge_ps(max_image_x, one)),
+            _mm_or_ps(_mm_cmple_ps(min_image_y, minus_one), _mm_cmpge_ps(max_image_y, one)));
+        
+        __m128 reaches_nearest_image = _mm_and_ps(
+            _mm_and_ps(_mm_cmple_ps(min_image_x, zero), _mm_cmpge_ps(max_image_x, zero)),
+            _mm_and_ps(_mm_cmple_ps(min_image_y, zero), _mm_cmpge_ps(max_image_y, zero)));
+        
+        // roots
+        __m128 a = _mm_add_ps(_mm_mul_ps(sweep_x, sweep_x), _mm_mul_ps(sweep_y, sweep_y));
+        __m128 b = _mm_add_ps(_mm_mul_ps(distance_x, sweep_x), _mm_mul_ps(distance_y, sweep_y));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(distance_x, distance_x), _mm_mul_ps(distance_y, distance_y)), _mm_mul_ps(sum_radius, sum_radius));
+        __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+        
+        __m128 has_two_roots = _mm_cmpgt_ps(discriminant, zero);
+        
+        __m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        __m128 minus_b = _mm_sub_ps(zero, b);
+        __m128 t0 = _mm_div_ps(_mm_sub_ps(minus_b, root), a);
+        __m128 t1 = _mm_div_ps(_mm_add_ps(minus_b, root), a);
+        
+        __m128 approaching_fraction = _mm_min_ps(_mm_max_ps(_mm_sub_ps(t0, relative_margin), zero), one);
+        
+        __m128 is_overlapping = _mm_and_ps(_mm_cmpge_ps(t1, zero), _mm_cmplt_ps(_mm_sub_ps(zero, t0), t1));
+        __m128 overlapping_fraction = select_ps(is_overlapping, zero, one);
+        
+        __m128 fraction = select_ps(_mm_cmpgt_ps(t0, zero), approaching_fraction, overlapping_fraction);
+        fraction = select_ps(_mm_and_ps(has_two_roots, reaches_nearest_image), fraction, one);
+        fraction = select_ps(reaches_other_images, needs_all_images, fraction);
+        fraction = select_ps(is_moving, fraction, one);
+        
+        _mm_storeu_ps(fractions + i, fraction);
+    }
+    
+#endif
+    
+    for (; i < batch.count; ++i)
+        fractions[i] = get_swept_sphere_fraction(moving_sphere.center.x, moving_sphere.center.y, moving_velocity.x, moving_velocity.y, moving_sphere.radius, batch.center_x[i], batch.center_y[i], batch.velocity_x[i], batch.velocity_y[i], batch.radius[i], area_size.x, area_size.y, timestep, margin);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+// batched make_transform(make_quat(axis, angle), translation, make_vec3_scale(scale)),
+// for the root entity transforms that build_draw_lists rebuilds every frame.
+// sin and cos come from get_fast_sin_cos instead of the c library.
+// the AVX2 or SSE2 paths are picked at compile time, like in swept_sphere.h,
+// they do the same operations in the same order as the scalar path,
+// so all paths give bit identical results (without fma contraction).
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define TRANSFORM_BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define TRANSFORM_BATCH_SSE2
+#endif
+
+// 1.5 * 2^23, adding and subtracting it rounds to the nearest integer
+#define Fast_Sin_Cos_Round_Magic 12582912.0f
+
+#define Fast_Sin_Cos_Two_Over_Pi 0.636619772367581343f
+
+// pi / 2 in 3 parts, the first two have few mantissa bits,
+// so multiples of them are exact for the quadrants we care about
+#define Fast_Sin_Cos_Pi_Over_Two_1 1.5703125f
+#define Fast_Sin_Cos_Pi_Over_Two_2 4.837512969970703125e-4f
+#define Fast_Sin_Cos_Pi_Over_Two_3 7.54978995489188216e-8f
+
+// minimax polynomials on [-pi/4, pi/4] (from cephes sinf and cosf)
+#define Fast_Sin_Cos_S1 -1.6666654611e-1f
+#define Fast_Sin_Cos_S2  8.3321608736e-3f
+#define Fast_Sin_Cos_S3 -1.9515295891e-4f
+#define Fast_Sin_Cos_C1  4.166664568298827e-2f
+#define Fast_Sin_Cos_C2 -1.388731625493765e-3f
+#define Fast_Sin_Cos_C3  2.443315711809948e-5f
+
+// keeps accumulated angles in [-pi, pi), inside the precise range of get_fast_sin_cos
+inline f32 wrap_angle(f32 angle)
+{
+    return angle - 2 * PIf * floor(angle / (2 * PIf) + 0.5f);
+}
+
+// absolute error of sin and cos is below 1e-7 for |angle| < 1e4 (measured against double),
+// the reduction to [-pi/4, pi/4] loses precision for larger angles
+// and is wrong for |angle| >= 2^22.
+// one lane of the batched kernel
+inline void get_fast_sin_cos(f32 *sin_result, f32 *cos_result, f32 angle)
+{
+    f32 quadrant = (angle * Fast_Sin_Cos_Two_Over_Pi + Fast_Sin_Cos_Round_Magic) - Fast_Sin_Cos_Round_Magic;
+    
+    f32 x = angle - quadrant * Fast_Sin_Cos_Pi_Over_Two_1;
+    x = x - quadrant * Fast_Sin_Cos_Pi_Over_Two_2;
+    x = x - quadrant * Fast_Sin_Cos_Pi_Over_Two_3;
+    
+    f32 x2 = x * x;
+    f32 sin_x = x + (x * x2) * (Fast_Sin_Cos_S1 + x2 * (Fast_Sin_Cos_S2 + x2 * Fast_Sin_Cos_S3));
+    f32 cos_x = (1.0f - 0.5f * x2) + (x2 * x2) * (Fast_Sin_Cos_C1 + x2 * (Fast_Sin_Cos_C2 + x2 * Fast_Sin_Cos_C3));
+    
+    s32 quadrant_index = cast_v(s32, quadrant);
+    
+    if (quadrant_index & 1) {
+        f32 temp = sin_x;
+        sin_x = cos_x;
+        cos_x = temp;
+    }
+    
+    if (quadrant_index & 2)
+        sin_x = -sin_x;
+    
+    if ((quadrant_index + 1) & 2)
+        cos_x = -cos_x;
+    
+    *sin_result = sin_x;
+    *cos_result = cos_x;
+}
+
+// rotation and scale of one transform from the quaternion make_quat(axis, angle) builds
+inline void set_fast_transform_rotation(mat4x3f *transform, vec3f axis, f32 angle, f32 scale)
+{
+    f32 s, c;
+    get_fast_sin_cos(&s, &c, angle * 0.5f);
+    
+    f32 x = axis.x * s;
+    f32 y = axis.y * s;
+    f32 z = axis.z * s;
+    f32 w = c;
+    
+    f32 xx = x * x;
+    f32 yy = y * y;
+    f32 zz = z * z;
+    f32 xy = x * y;
+    f32 xz = x * z;
+    f32 yz = y * z;
+    f32 wx = w * x;
+    f32 wy = w * y;
+    f32 wz = w * z;
+    
+    transform->right.x   = (1.0f - 2.0f * (yy + zz)) * scale;
+    transform->right.y   = (2.0f * (xy + wz)) * scale;
+    transform->right.z   = (2.0f * (xz - wy)) * scale;
+    transform->up.x      = (2.0f * (xy - wz)) * scale;
+    transform->up.y      = (1.0f - 2.0f * (xx + zz)) * scale;
+    transform->up.z      = (2.0f * (yz + wx)) * scale;
+    transform->forward.x = (2.0f * (xz + wy)) * scale;
+    transform->forward.y = (2.0f * (yz - wx)) * scale;
+    transform->forward.z = (1.0f - 2.0f * (xx + yy)) * scale;
+}
+
+// matrix columns right, up and forward, one register per component
+#define Transform_Batch_Component_Count 9
+
+#if defined(TRANSFORM_BATCH_AVX2)
+
+#define Transform_Batch_Lane_Count 8
+
+inline void get_fast_transform_rotations(__m256 components[Transform_Batch_Component_Count], vec3f *axes, f32 *angles, f32 *scales)
+{
+    __m256 angle = _mm256_mul_ps(_mm256_loadu_ps(angles), _mm256_set1_ps(0.5f));
+    
+    __m256 magic = _mm256_set1_ps(Fast_Sin_Cos_Round_Magic);
+    __m256 quadrant = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(angle, _mm256_set1_ps(Fast_Sin_Cos_Two_Over_Pi)), magic), magic);
+    
+    __m256 x = _mm256_sub_ps(angle, _mm256_mul_ps(quadrant, _mm256_set1_ps(Fast_Sin_Cos_Pi_Over_Two_1)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(Fast_Sin_Cos_Pi_Over_Two_2)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(Fast_Sin_Cos_Pi_Over_Two_3)));
+    
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 sin_x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(x, x2), _mm256_add_ps(_mm256_set1_ps(Fast_Sin_Cos_S1), _mm256_mul_ps(x2, _mm256_add_ps(_mm256_set1_ps(Fast_Sin_Cos_S2), _mm256_mul_ps(x2, _mm256_set1_ps(Fast_Sin_Cos_S3)))))));
+    __m256 cos_x = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), x2)), _mm256_mul_ps(_mm256_mul_ps(x2, x2), _mm256_add_ps(_mm256_set1_ps(Fast_Sin_Cos_C1), _mm256_mul_ps(x2, _mm256_add_ps(_mm256_set1_ps(Fast_Sin_Cos_C2), _mm256_mul_ps(x2, _mm256_set1_ps(Fast_Sin_Cos_C3)))))));
+    
+    __m256i quadrant_index = _mm256_cvttps_epi32(quadrant);
+    __m256 is_odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant_index, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant_index, _mm256_set1_epi32(2)), 30));
+    __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant_index, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    
+    __m256 s = _mm256_xor_ps(_mm256_blendv_ps(sin_x, cos_x, is_odd), sin_sign);
+    __m256 c = _mm256_xor_ps(_mm256_blendv_ps(cos_x, sin_x, is_odd), cos_sign);
+    
+    __m256 qx = _mm256_mul_ps(_mm256_set_ps(axes[7].x, axes[6].x, axes[5].x, axes[4].x, axes[3].x, axes[2].x, axes[1].x, axes[0].x), s);
+    __m256 qy = _mm256_mul_ps(_mm256_set_ps(axes[7].y, axes[6].y, axes[5].y, axes[4].y, axes[3].y, axes[2].y, axes[1].y, axes[0].y), s);
+    __m256 qz = _mm256_mul_ps(_mm256_set_ps(axes[7].z, axes[6].z, axes[5].z, axes[4].z, axes[3].z, axes[2].z, axes[1].z, axes[0].z), s);
+    __m256 qw = c;
+    
+    __m256 xx = _mm256_mul_ps(qx, qx);
+    __m256 yy = _mm256_mul_ps(qy, qy);
+    __m256 zz = _mm256_mul_ps(qz, qz);
+    __m256 xy = _mm256_mul_ps(qx, qy);
+    __m256 xz = _mm256_mul_ps(qx, qz);
+    __m256 yz = _mm256_mul_ps(qy, qz);
+    __m256 wx = _mm256_mul_ps(qw, qx);
+    __m256 wy = _mm256_mul_ps(qw, qy);
+    __m256 wz = _mm256_mul_ps(qw, qz);
+    
+    __m256 one   = _mm256_set1_ps(1.0f);
+    __m256 two   = _mm256_set1_ps(2.0f);
+    __m256 scale = _mm256_loadu_ps(scales);
+    
+    components[0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), scale);
+    components[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scale);
+    components[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scale);
+    components[3] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scale);
+    components[4] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), scale);
+    components[5] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scale);
+    components[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scale);
+    components[7] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scale);
+    components[8] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), scale);
+}
+
+#elif defined(TRANSFORM_BATCH_SSE2)
+
+#define Transform_Batch_Lane_Count 4
+
+inline void get_fast_transform_rotations(__m128 components[Transform_Batch_Component_Count], vec3f *axes, f32 *angles, f32 *scales)
+{
+    __m128 angle = _mm_mul_ps(_mm_loadu_ps(angles), _mm_set1_ps(0.5f));
+    
+    __m128 magic = _mm_set1_ps(Fast_Sin_Cos_Round_Magic);
+    __m128 quadrant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(angle, _mm_set1_ps(Fast_Sin_Cos_Two_Over_Pi)), magic), magic);
+    
+    __m128 x = _mm_sub_ps(angle, _mm_mul_ps(quadrant, _mm_set1_ps(Fast_Sin_Cos_Pi_Over_Two_1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(Fast_Sin_Cos_Pi_Over_Two_2)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(Fast_Sin_Cos_Pi_Over_Two_3)));
+    
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 sin_x = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), _mm_add_ps(_mm_set1_ps(Fast_Sin_Cos_S1), _mm_mul_ps(x2, _mm_add_ps(_mm_set1_ps(Fast_Sin_Cos_S2), _mm_mul_ps(x2, _mm_set1_ps(Fast_Sin_Cos_S3)))))));
+    __m128 cos_x = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), x2)), _mm_mul_ps(_mm_mul_ps(x2, x2), _mm_add_ps(_mm_set1_ps(Fast_Sin_Cos_C1), _mm_mul_ps(x2, _mm_add_ps(_mm_set1_ps(Fast_Sin_Cos_C2), _mm_mul_ps(x2, _mm_set1_ps(Fast_Sin_Cos_C3)))))));
+    
+    __m128i quadrant_index = _mm_cvttps_epi32(quadrant);
+    __m128 is_odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant_index, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant_index, _mm_set1_epi32(2)), 30));
+    __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant_index, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    
+    __m128 s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(is_odd, cos_x), _mm_andnot_ps(is_odd, sin_x)), sin_sign);
+    __m128 c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(is_odd, sin_x), _mm_andnot_ps(is_odd, cos_x)), cos_sign);
+    
+    __m128 qx = _mm_mul_ps(_mm_set_ps(axes[3].x, axes[2].x, axes[1].x, axes[0].x), s);
+    __m128 qy = _mm_mul_ps(_mm_set_ps(axes[3].y, axes[2].y, axes[1].y, axes[0].y), s);
+    __m128 qz = _mm_mul_ps(_mm_set_ps(axes[3].z, axes[2].z, axes[1].z, axes[0].z), s);
+    __m128 qw = c;
+    
+    __m128 xx = _mm_mul_ps(qx, qx);
+    __m128 yy = _mm_mul_ps(qy, qy);
+    __m128 zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy);
+    __m128 xz = _mm_mul_ps(qx, qz);
+    __m128 yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx);
+    __m128 wy = _mm_mul_ps(qw, qy);
+    __m128 wz = _mm_mul_ps(qw, qz);
+    
+    __m128 one   = _mm_set1_ps(1.0f);
+    __m128 two   = _mm_set1_ps(2.0f);
+    __m128 scale = _mm_loadu_ps(scales);
+    
+    components[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scale);
+    components[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scale);
+    components[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scale);
+    components[3] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scale);
+    components[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scale);
+    components[5] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scale);
+    components[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scale);
+    components[7] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scale);
+    components[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scale);
+}
+
+#endif
+
+// sets right, up and forward of each transform from axes, angles and scales,
+// the translations are kept
+void set_fast_transform_rotations(mat4x3f *transforms, vec3f *axes, f32 *angles, f32 *scales, u32 count)
+{
+    u32 i = 0;
+    
+#if defined(TRANSFORM_BATCH_AVX2) || defined(TRANSFORM_BATCH_SSE2)
+    
+    for (; i + Transform_Batch_Lane_Count <= count; i += Transform_Batch_Lane_Count) {
+#  if defined(TRANSFORM_BATCH_AVX2)
+        __m256 components[Transform_Batch_Component_Count];
+        get_fast_transform_rotations(components, axes + i, angles + i, scales + i);
+        
+        f32 lanes[Transform_Batch_Component_Count][Transform_Batch_Lane_Count];
+        for (u32 component = 0; component < Transform_Batch_Component_Count; ++component)
+            _mm256_storeu_ps(lanes[component], components[component]);
+#  else
+        __m128 components[Transform_Batch_Component_Count];
+        get_fast_transform_rotations(components, axes + i, angles + i, scales + i);
+        
+        f32 lanes[Transform_Batch_Component_Count][Transform_Batch_Lane_Count];
+        for (u32 component = 0; component < Transform_Batch_Component_Count; ++component)
+            _mm_storeu_ps(lanes[component], components[component]);
+#  endif
+        
+        // transpose into the matrix columns
+        for (u32 lane = 0; lane < Transform_Batch_Lane_Count; ++lane) {
+            mat4x3f *transform = transforms + i + lane;
+            transform->right   = vec3f{ lanes[0][lane], lanes[1][lane], lanes[2][lane] };
+            transform->up      = vec3f{ lanes[3][lane], lanes[4][lane], lanes[5][lane] };
+            transform->forward = vec3f{ lanes[6][lane], lanes[7][lane], lanes[8][lane] };
+        }
+    }
+    
+#endif
+    
+    for (; i < count; ++i)
+        set_fast_transform_rotation(transforms + i, axes[i], angles[i], scales[i]);
+}
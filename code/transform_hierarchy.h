@@ -0,0 +1,109 @@
+#pragma once
+
+// child entities follow the world transform of their parent.
+// nodes are kept in topological order, every node comes after the node of its parent
+// (or its parent is a root entity without node), so one pass in order updates
+// any attachment depth.
+// world transforms are only rebuilt if the entity is flagged with Entity_Transform_Rotation_Dirty
+// or its parent has Entity_Transform_World_Changed, see build_draw_lists.
+// needs entity_pool.h and transform_batch.h.
+
+struct Transform_Node {
+    Entity_Handle entity;
+    Entity_Handle parent;
+    
+    // only the translation is relative to the parent,
+    // the rotation comes from the orientation of the entity itself
+    mat4x3f local_transform;
+};
+
+struct Transform_Hierarchy {
+    // needs to support free in any order
+    Memory_Allocator *allocator;
+    
+    Transform_Node *nodes;
+    u32 count;
+    u32 capacity;
+};
+
+void init_transform_hierarchy(Transform_Hierarchy *hierarchy, Memory_Allocator *allocator, u32 capacity = 16)
+{
+    *hierarchy = {};
+    hierarchy->allocator = allocator;
+    hierarchy->nodes = ALLOCATE_ARRAY(allocator, Transform_Node, capacity);
+    hierarchy->capacity = capacity;
+}
+
+// parent has to be attached before entity or be a root entity,
+// entity can only be attached once
+void attach_entity(Transform_Hierarchy *hierarchy, Entity_Pool *pool, Entity_Handle entity, Entity_Handle parent, mat4x3f local_transform)
+{
+    Entity_Slot slot = get_entity_slot(pool, entity);
+    assert(slot.chunk && (slot.chunk->body_indices[slot.index] == Entity_No_Body));
+    assert(get_entity_slot(pool, parent).chunk);
+    
+    if (hierarchy->count == hierarchy->capacity) {
+        u32 capacity = hierarchy->capacity * 2;
+        Transform_Node *nodes = ALLOCATE_ARRAY(hierarchy->allocator, Transform_Node, capacity);
+        COPY(nodes, hierarchy->nodes, sizeof(Transform_Node) * hierarchy->count);
+        
+        free(hierarchy->allocator, hierarchy->nodes);
+        hierarchy->nodes = nodes;
+        hierarchy->capacity = capacity;
+    }
+    
+    Transform_Node *node = hierarchy->nodes + hierarchy->count++;
+    node->entity = entity;
+    node->parent = parent;
+    node->local_transform = local_transform;
+    
+    slot.chunk->transform_flags[slot.index] |= Entity_Transform_Rotation_Dirty;
+}
+
+// call after entities were removed from the pool,
+// removes their nodes and also removes all their descendants from the pool
+void remove_orphaned_transform_nodes(Transform_Hierarchy *hierarchy, Entity_Pool *pool)
+{
+    u32 count = 0;
+    
+    for (u32 i = 0; i < hierarchy->count; ++i) {
+        Transform_Node *node = hierarchy->nodes + i;
+        
+        if (!get_entity_slot(pool, node->entity).chunk)
+            continue;
+        
+        // parent nodes come first, so a removed grandparent already removed the parent
+        if (!get_entity_slot(pool, node->parent).chunk) {
+            remove_entity(pool, node->entity.index);
+            continue;
+        }
+        
+        hierarchy->nodes[count++] = *node;
+    }
+    
+    hierarchy->count = count;
+}
+
+// updates the world transforms of all attached entities in topological order
+void update_transform_hierarchy(Transform_Hierarchy *hierarchy, Entity_Pool *pool)
+{
+    for (u32 i = 0; i < hierarchy->count; ++i) {
+        Transform_Node *node = hierarchy->nodes + i;
+        
+        Entity_Slot parent = get_entity_slot(pool, node->parent);
+        Entity_Slot slot   = get_entity_slot(pool, node->entity);
+        
+        u8 *flags = slot.chunk->transform_flags + slot.index;
+        
+        if (!(*flags & Entity_Transform_Rotation_Dirty) && !(parent.chunk->transform_flags[parent.index] & Entity_Transform_World_Changed)) {
+            *flags &= ~Entity_Transform_World_Changed;
+            continue;
+        }
+        
+        mat4x3f *transform = slot.chunk->to_world_transforms + slot.index;
+        set_fast_transform_rotation(transform, slot.chunk->angular_rotation_axes[slot.index], slot.chunk->orientations[slot.index], slot.chunk->scales[slot.index]);
+        transform->translation = transform_point(parent.chunk->to_world_transforms[parent.index], node->local_transform.translation);
+        
+        *flags = Entity_Transform_World_Changed;
+    }
+}
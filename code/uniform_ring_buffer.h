@@ -0,0 +1,150 @@
+#pragma once
+
+// streams uniform blocks without sync points.
+// one buffer object is split into Uniform_Ring_Frame_Count regions, a frame writes into its own region
+// while the gpu may still read the regions of the last frames. a fence per region tells when it
+// can be written again, with three regions that should never block.
+// the region is mapped unsynchronized, so the driver does not wait for pending draws either.
+// persistent mapping would save the map per frame, but needs gl 4.4 buffer storage,
+// the shaders target 3.2.
+// needs gl.
+//
+// per frame: begin_uniform_frame, allocate_uniforms and bind_uniforms as needed,
+// unmap_uniform_frame before drawing, end_uniform_frame after the last draw that reads the frame.
+
+#define Uniform_Ring_Frame_Count 3
+
+// wait in steps of 1 ms, so a lost context does not hang forever
+#define Uniform_Ring_Wait_Timeout_Nanoseconds 1000000
+
+struct Uniform_Allocation {
+    void *data;
+    
+    // in the buffer object, for glBindBufferRange
+    u32 offset;
+    u32 byte_count;
+};
+
+struct Uniform_Ring_Buffer {
+    GLuint buffer_object;
+    
+    u32 frame_byte_count;
+    u32 offset_alignment;
+    
+    u32 frame_index;
+    GLsync fences[Uniform_Ring_Frame_Count];
+    
+    // mapped region of the current frame, null while unmapped
+    u8 *frame_data;
+    u32 frame_used_byte_count;
+    
+    // frames that found their region still in use, should stay 0
+    u32 wait_count;
+};
+
+void init_uniform_ring_buffer(Uniform_Ring_Buffer *ring, u32 frame_byte_count)
+{
+    *ring = {};
+    
+    GLint offset_alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+    ring->offset_alignment = MAX(offset_alignment, 1);
+    
+    // every region starts aligned
+    ring->frame_byte_count = (frame_byte_count + ring->offset_alignment - 1) / ring->offset_alignment * ring->offset_alignment;
+    
+    glGenBuffers(1, &ring->buffer_object);
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer_object);
+    glBufferData(GL_UNIFORM_BUFFER, ring->frame_byte_count * Uniform_Ring_Frame_Count, null, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void free_uniform_ring_buffer(Uniform_Ring_Buffer *ring)
+{
+    for (u32 i = 0; i < Uniform_Ring_Frame_Count; ++i) {
+        if (ring->fences[i])
+            glDeleteSync(ring->fences[i]);
+    }
+    
+    glDeleteBuffers(1, &ring->buffer_object);
+    *ring = {};
+}
+
+// waits until the gpu is done with the region of this frame and maps it
+void begin_uniform_frame(Uniform_Ring_Buffer *ring)
+{
+    assert(!ring->frame_data);
+    
+    GLsync fence = ring->fences[ring->frame_index];
+    if (fence) {
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        
+        if (result != GL_ALREADY_SIGNALED) {
+            PROFILE_SCOPE("wait for uniform ring buffer");
+            
+            ++ring->wait_count;
+            
+            // GL_WAIT_FAILED only happens with a broken fence, do not keep waiting then
+            while (result == GL_TIMEOUT_EXPIRED)
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, Uniform_Ring_Wait_Timeout_Nanoseconds);
+        }
+        
+        glDeleteSync(fence);
+        ring->fences[ring->frame_index] = 0;
+    }
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer_object);
+    ring->frame_data = cast_p(u8, glMapBufferRange(GL_UNIFORM_BUFFER, ring->frame_index * ring->frame_byte_count, ring->frame_byte_count, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    assert(ring->frame_data);
+    ring->frame_used_byte_count = 0;
+}
+
+// only between begin_uniform_frame and unmap_uniform_frame
+Uniform_Allocation allocate_uniforms(Uniform_Ring_Buffer *ring, u32 byte_count)
+{
+    assert(ring->frame_data);
+    
+    u32 offset = (ring->frame_used_byte_count + ring->offset_alignment - 1) / ring->offset_alignment * ring->offset_alignment;
+    assert(offset + byte_count <= ring->frame_byte_count);
+    
+    ring->frame_used_byte_count = offset + byte_count;
+    
+    Uniform_Allocation allocation;
+    allocation.data       = ring->frame_data + offset;
+    allocation.offset     = ring->frame_index * ring->frame_byte_count + offset;
+    allocation.byte_count = byte_count;
+    
+    return allocation;
+}
+
+void bind_uniforms(Uniform_Ring_Buffer *ring, GLuint binding_index, Uniform_Allocation allocation)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding_index, ring->buffer_object, allocation.offset, allocation.byte_count);
+}
+
+// the region has to be unmapped before draws read it
+void unmap_uniform_frame(Uniform_Ring_Buffer *ring)
+{
+    assert(ring->frame_data);
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer_object);
+    
+    if (ring->frame_used_byte_count)
+        glFlushMappedBufferRange(GL_UNIFORM_BUFFER, 0, ring->frame_used_byte_count);
+    
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    ring->frame_data = null;
+}
+
+// call after the last draw of the frame, the region is reused Uniform_Ring_Frame_Count frames later
+void end_uniform_frame(Uniform_Ring_Buffer *ring)
+{
+    assert(!ring->frame_data);
+    
+    ring->fences[ring->frame_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring->frame_index = (ring->frame_index + 1) % Uniform_Ring_Frame_Count;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// fork/join helper for splitting work across cores.
+// threads are started and joined in each call, so no thread
+// outlives the call and keeps running code of an unloaded dll
+// while live code editing.
+
+#include <thread>
+
+#define Max_Worker_Count 16
+
+#include "profiler.h"
+
+typedef void (*Worker_Function)(void *data, u32 worker_index);
+
+// number of workers to use, including the calling thread
+u32 get_worker_count()
+{
+    u32 count = std::thread::hardware_concurrency();
+    
+    // hardware_concurrency may return 0 if it can not tell
+    return CLAMP(count, 1, Max_Worker_Count);
+}
+
+// calls function once for each worker index in [0, worker_count),
+// worker 0 runs on the calling thread. returns after all workers are done.
+void run_workers(u32 worker_count, Worker_Function function, void *data)
+{
+    assert(worker_count && (worker_count <= Max_Worker_Count));
+    
+    std::thread threads[Max_Worker_Count - 1];
+    
+    for (u32 i = 1; i < worker_count; ++i)
+        threads[i - 1] = std::thread([=] {
+            set_profile_thread_index(i);
+            function(data, i);
+        });
+    
+    function(data, 0);
+    
+    for (u32 i = 1; i < worker_count; ++i)
+        threads[i - 1].join();
+}